@@ -0,0 +1,353 @@
+#include "graph.h"
+#include "network.h"
+#include "trainer.h"
+#include "pixelkernel.h"
+#include "colourlut.h"
+#include "imageapply.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const unsigned seed = 20240117;
+
+/* Minimum wall time spent in each benchmark */
+const double min_seconds = 0.25;
+
+struct bench_result {
+    std::string name;
+    size_t iterations;
+    double ns_per_op;
+    double items_per_second;
+};
+
+/* How far a single precision path strays from the double one, measured
+ * in 8-bit colour levels over a set of random colours */
+struct accuracy_result {
+    std::string name;
+    double max_levels;
+    double mismatched; /* fraction of channels that round differently */
+};
+
+/* Largest difference allowed before the run is reported as failing */
+const double max_levels_allowed = 1.0;
+
+int to_8bit(const double value) {
+    return int(std::lround(std::min(std::max(value, 0.0), 1.0) * 255));
+}
+
+accuracy_result compare(const std::string& name, const std::vector<double>& reference, const std::vector<double>& single) {
+    accuracy_result result;
+    result.name = name;
+    result.max_levels = 0;
+    size_t mismatched = 0;
+    for (size_t i = 0; i < reference.size(); ++i) {
+        result.max_levels = std::max(result.max_levels, std::fabs(reference[i] - single[i]) * 255);
+        mismatched += to_8bit(reference[i]) != to_8bit(single[i]);
+    }
+    result.mismatched = double(mismatched) / reference.size();
+    std::cerr << name << ": " << result.max_levels << " levels" << std::endl;
+    return result;
+}
+
+/* Runs op in growing batches until min_seconds have passed. Each call to
+ * op counts as one operation covering items_per_op items. */
+bench_result measure(const std::string& name, const double items_per_op, const std::function<void()>& op) {
+    op(); /* warm up */
+    size_t batch = 1;
+    size_t iterations = 0;
+    double elapsed = 0;
+    while (elapsed < min_seconds) {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+            op();
+        }
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        elapsed += duration.count();
+        iterations += batch;
+        batch *= 2;
+    }
+    bench_result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.ns_per_op = elapsed / iterations * 1e9;
+    result.items_per_second = items_per_op * iterations / elapsed;
+    std::cerr << name << ": " << result.ns_per_op << " ns/op" << std::endl;
+    return result;
+}
+
+/* The run_thread network and error graph, built on the graph engine */
+struct graph_network {
+    graph_network(std::mt19937& rng, const size_t hidden) {
+        std::uniform_real_distribution<double> weight(-1, 1);
+        input.resize(3);
+        for (size_t i = 0; i < input.size(); ++i) {
+            input[i] = bp.parameter();
+            bp.set_parameter(input[i], 0.5);
+        }
+        bp_layer layer1(bp, input, hidden, false);
+        bp_layer output_layer(bp, layer1.outputs_, 3, true);
+        outputs = output_layer.outputs_;
+        parameters = layer1.parameters_;
+        parameters.insert(std::end(parameters), std::begin(output_layer.parameters_), std::end(output_layer.parameters_));
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            bp.set_parameter(parameters[i], weight(rng));
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            graph_builder target = bp.constant(0.25);
+            graph_builder e = output_layer.outputs_[i] - target;
+            e = e * e;
+            error = error.empty() ? e : error + e;
+        }
+    }
+    graph_evaluator bp;
+    std::vector<graph_builder> input;
+    std::vector<graph_builder> outputs;
+    std::vector<graph_builder> parameters;
+    graph_builder error;
+};
+
+std::vector<double> random_vector(std::mt19937& rng, const size_t size, const double low, const double high) {
+    std::uniform_real_distribution<double> value(low, high);
+    std::vector<double> result(size);
+    for (size_t i = 0; i < size; ++i) {
+        result[i] = value(rng);
+    }
+    return result;
+}
+
+QImage synthetic_image(std::mt19937& rng, const int size) {
+    QImage image(size, size, QImage::Format_RGB32);
+    std::uniform_int_distribution<int> channel(0, 255);
+    for (int y = 0; y < size; ++y) {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < size; ++x) {
+            line[x] = qRgb(channel(rng), channel(rng), channel(rng));
+        }
+    }
+    return image;
+}
+
+void write_json(std::ostream& out, const std::vector<bench_result>& results, const std::vector<accuracy_result>& accuracy) {
+    out << "{" << std::endl;
+    out << "  \"seed\": " << seed << "," << std::endl;
+    out << "  \"benchmarks\": [" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << r.ns_per_op << ", \"items_per_second\": " << r.items_per_second << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "  ]," << std::endl;
+    out << "  \"accuracy\": [" << std::endl;
+    for (size_t i = 0; i < accuracy.size(); ++i) {
+        const accuracy_result& r = accuracy[i];
+        out << "    {\"name\": \"" << r.name << "\", \"max_levels\": " << r.max_levels
+            << ", \"mismatched\": " << r.mismatched << "}"
+            << (i + 1 < accuracy.size() ? "," : "") << std::endl;
+    }
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+std::string name(const std::string& prefix, const size_t value) {
+    std::stringstream ss;
+    ss << prefix << "/" << value;
+    return ss.str();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    std::string output_file;
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output_file = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "usage: qtmixer-bench [--output <file.json>] [--filter <name prefix>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<bench_result> results;
+    std::vector<accuracy_result> accuracy;
+    auto run = [&](const std::string& bench_name, const double items_per_op, const std::function<void()>& op) {
+        if (bench_name.compare(0, filter.size(), filter) == 0) {
+            results.push_back(measure(bench_name, items_per_op, op));
+        }
+    };
+
+    const size_t widths[] = { 4, 8, 16, 32 };
+
+    for (const size_t hidden : widths) {
+        std::mt19937 rng(seed);
+        graph_network net(rng, hidden);
+        run(name("graph_evaluator/evaluate", hidden), 1, [&] {
+            net.bp.evaluate(net.error);
+        });
+        run(name("graph_evaluator/evaluate_delta", hidden), 1, [&] {
+            net.bp.evaluate_delta(net.error, net.parameters[0]);
+        });
+
+        graph_program program(net.bp, net.error);
+        std::vector<size_t> slots(net.parameters.size());
+        for (size_t i = 0; i < slots.size(); ++i) {
+            slots[i] = program.slot(net.parameters[i]);
+        }
+        std::vector<double> gradient;
+        run(name("graph_program/evaluate", hidden), 1, [&] {
+            program.evaluate();
+        });
+        run(name("graph_program/gradient", hidden), 1, [&] {
+            program.gradient(slots, gradient);
+        });
+
+        /* Inference only: the outputs without the loss built on them */
+        graph_program inference(net.bp, net.outputs);
+        std::vector<double> results;
+        run(name("graph_program/evaluate_outputs", hidden), 1, [&] {
+            inference.evaluate(results);
+        });
+        graph_program_float inference_float(net.bp, net.outputs);
+        std::vector<float> results_float;
+        run(name("graph_program_float/evaluate_outputs", hidden), 1, [&] {
+            inference_float.evaluate(results_float);
+        });
+
+        const std::vector<double> colours = random_vector(rng, 4096 * 3, 0, 1);
+        std::vector<double> reference;
+        std::vector<double> single;
+        for (size_t i = 0; i < colours.size(); i += 3) {
+            for (size_t c = 0; c < 3; ++c) {
+                inference.set_parameter(net.input[c], colours[i + c]);
+                inference_float.set_parameter(net.input[c], float(colours[i + c]));
+            }
+            inference.evaluate(results);
+            inference_float.evaluate(results_float);
+            reference.insert(std::end(reference), std::begin(results), std::end(results));
+            single.insert(std::end(single), std::begin(results_float), std::end(results_float));
+        }
+        accuracy.push_back(compare(name("graph_program_float", hidden), reference, single));
+
+        run(name("bp_layer/construct", hidden), 1, [&] {
+            std::mt19937 build_rng(seed);
+            graph_network built(build_rng, hidden);
+        });
+    }
+
+    for (const size_t hidden : widths) {
+        const size_t samples = 256;
+        std::mt19937 rng(seed);
+        const std::vector<double> inputs = random_vector(rng, samples * 3, 0, 1);
+        const std::vector<double> targets = random_vector(rng, samples * 3, 0, 1);
+
+        dense_network network(std::vector<size_t>{ 3, hidden, 3 });
+        network.parameters() = random_vector(rng, network.num_parameters(), -1, 1);
+        const std::vector<double> initial = network.parameters();
+
+        network_trainer single(network, inputs, targets, 1);
+        run(name("train/step_batch1", hidden), 1, [&] {
+            single.step(1e-6);
+        });
+
+        network.parameters() = initial;
+        network_trainer full(network, inputs, targets, 0);
+        run(name("train/step_full256", hidden), samples, [&] {
+            full.step(1e-6);
+        });
+    }
+
+    const int sizes[] = { 256, 1024, 2048 };
+    const std::atomic<bool> abort(false);
+    for (const int size : sizes) {
+        std::mt19937 rng(seed);
+        const QImage source = prepare_image(synthetic_image(rng, size));
+
+        dense_network network(std::vector<size_t>{ 3, 4, 3 });
+        const std::vector<double> parameters = random_vector(rng, network.num_parameters(), -1, 1);
+        const pixel_kernel kernel(network.widths(), std::vector<float>(std::begin(parameters), std::end(parameters)));
+        const colour_lut lut(kernel, 33, colour_lut::tetrahedral);
+
+        if (size == sizes[0]) {
+            /* The apply path runs in float; check it against the network in double */
+            network.parameters() = parameters;
+            const size_t count = 4096;
+            const std::vector<double> colours = random_vector(rng, count * 3, 0, 1);
+            dense_workspace workspace(network, count);
+            const double* outputs = network.forward(workspace, colours.data(), count);
+            /* pixel_kernel clamps its outputs to the unit range, so the
+             * reference is clamped the same way */
+            std::vector<double> reference(count * 3);
+            for (size_t i = 0; i < count * 3; ++i) {
+                reference[i] = std::min(1.0, std::max(0.0, outputs[i]));
+            }
+            std::vector<float> planes[3];
+            for (size_t c = 0; c < 3; ++c) {
+                planes[c].resize(count);
+                for (size_t i = 0; i < count; ++i) {
+                    planes[c][i] = float(colours[i * 3 + c]);
+                }
+            }
+            const float* const input[3] = { planes[0].data(), planes[1].data(), planes[2].data() };
+            float* const output[3] = { planes[0].data(), planes[1].data(), planes[2].data() };
+            kernel.apply(input, output, count);
+            std::vector<double> single(count * 3);
+            for (size_t i = 0; i < count; ++i) {
+                for (size_t c = 0; c < 3; ++c) {
+                    single[i * 3 + c] = planes[c][i];
+                }
+            }
+            accuracy.push_back(compare("pixel_kernel", reference, single));
+        }
+
+        /* Each run maps the previous run's output again. Neither transform's
+         * cost depends on the colours, and copying outside the timed region
+         * keeps a full image copy out of every measurement. */
+        const double pixels = double(size) * double(size);
+        QImage image = source.copy();
+        run(name("apply/network", size_t(size)), pixels, [&] {
+            apply_direct(kernel, image, abort);
+        });
+        image = source.copy();
+        run(name("apply/lut33_tetrahedral", size_t(size)), pixels, [&] {
+            apply_direct(lut, image, abort);
+        });
+    }
+
+    if (output_file.empty()) {
+        write_json(std::cout, results, accuracy);
+    } else {
+        std::ofstream file(output_file);
+        write_json(file, results, accuracy);
+        if (!file) {
+            std::cerr << "Cannot write " << output_file << std::endl;
+            return 1;
+        }
+    }
+
+    for (const accuracy_result& r : accuracy) {
+        if (r.max_levels > max_levels_allowed) {
+            std::cerr << r.name << " differs from double precision by " << r.max_levels << " levels" << std::endl;
+            return 2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "runthread.h"
+#include "mappingfile.h"
+#include "imagestream.h"
+#include "imageapply.h"
+#include "modelfile.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+void usage() {
+    std::cerr << "usage: qtmixer-cli [options] <image> <mapping file> <output image>" << std::endl;
+    std::cerr << "       qtmixer-cli [options] --model <file> <image> <output image>" << std::endl;
+    std::cerr << "  --glsl <file>        write the GLSL snippet to file" << std::endl;
+    std::cerr << "  --cube <file>        write the baked LUT to file (needs 'lut' in the mapping file)" << std::endl;
+    std::cerr << "  --iterations <n>     training steps, overriding the mapping file" << std::endl;
+    std::cerr << "  --seconds <s>        stop training after s seconds, overriding the mapping file" << std::endl;
+    std::cerr << "  --strip-rows <n>     stream a .ppm image n rows at a time into a .ppm output" << std::endl;
+    std::cerr << "  --telemetry <file>   write error, gradient norm and step time as CSV" << std::endl;
+    std::cerr << "  --save-model <file>  write the trained model to file" << std::endl;
+    std::cerr << "  --model <file>       apply a saved model instead of training" << std::endl;
+}
+
+bool is_ppm(const std::string& file_name) {
+    return file_name.size() >= 4 && file_name.compare(file_name.size() - 4, 4, ".ppm") == 0;
+}
+
+/* Parses the whole of text as a number; trailing characters fail */
+template <typename T>
+bool parse_number(const std::string& text, T& value) {
+    std::stringstream ss(text);
+    char extra;
+    return (ss >> value) && !(ss >> extra);
+}
+
+bool write_text(const std::string& file_name, const std::string& text) {
+    std::ofstream file(file_name);
+    file << text;
+    return bool(file);
+}
+
+/* Applies a saved model without training. Returns the exit status. */
+int apply_model(const std::string& model_path, const std::string& input, const std::string& output, const int strip_rows, const std::string& glsl_file, const std::string& cube_file) {
+    const auto start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<const pixel_transform> transform;
+    std::string cube;
+    std::string glsl;
+    try {
+        const mapped_model model(model_path);
+        std::shared_ptr<pixel_kernel> kernel = model.kernel();
+        transform = kernel;
+        if (model.header().lut_size > 0) {
+            std::shared_ptr<colour_lut> lut = std::make_shared<colour_lut>(*kernel, model.header().lut_size, (model.header().flags & model_file::flag_tetrahedral) ? colour_lut::tetrahedral : colour_lut::trilinear);
+            cube = lut->cube("qtmixer");
+            transform = lut;
+        }
+        if (!glsl_file.empty()) {
+            dense_network network(model.widths());
+            std::copy(model.parameters(), model.parameters() + model.num_parameters(), std::begin(network.parameters()));
+            glsl = network.glsl();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    const std::chrono::duration<double> load_elapsed = std::chrono::steady_clock::now() - start;
+    const std::atomic<bool> abort(false);
+    const auto apply_start = std::chrono::steady_clock::now();
+    double pixels = 0;
+    if (strip_rows > 0) {
+        try {
+            pixels = stream_apply(*transform, input, output, strip_rows, abort);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    } else {
+        QImage image;
+        if (!image.load(QString::fromStdString(input))) {
+            std::cerr << "Cannot load " << input << std::endl;
+            return 1;
+        }
+        image = prepare_image(image);
+        if (!apply_cached(*transform, image, abort)) {
+            apply_direct(*transform, image, abort);
+        }
+        pixels = double(image.width()) * double(image.height());
+        if (!image.save(QString::fromStdString(output))) {
+            std::cerr << "Cannot write " << output << std::endl;
+            return 1;
+        }
+    }
+    const std::chrono::duration<double> apply_elapsed = std::chrono::steady_clock::now() - apply_start;
+
+    if (!glsl_file.empty() && !write_text(glsl_file, glsl)) {
+        std::cerr << "Cannot write " << glsl_file << std::endl;
+        return 1;
+    }
+    if (!cube_file.empty()) {
+        if (cube.empty()) {
+            std::cerr << "The model was not saved with a LUT" << std::endl;
+            return 1;
+        }
+        if (!write_text(cube_file, cube)) {
+            std::cerr << "Cannot write " << cube_file << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "load time: " << load_elapsed.count() * 1e3 << " ms" << std::endl;
+    std::cout << "apply rate: " << pixels / std::max(apply_elapsed.count(), 1e-9) / 1e6 << " Mpixel/s" << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    std::vector<std::string> positional;
+    std::string glsl_file;
+    std::string cube_file;
+    std::string telemetry_file;
+    std::string model_path;
+    std::string save_model_path;
+    long iterations = -1;
+    double seconds = 0;
+    int strip_rows = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if ((arg == "--glsl" || arg == "--cube" || arg == "--iterations" || arg == "--seconds" || arg == "--strip-rows" || arg == "--telemetry" || arg == "--model" || arg == "--save-model") && i + 1 < argc) {
+            const std::string value = argv[++i];
+            if (arg == "--glsl") {
+                glsl_file = value;
+            } else if (arg == "--cube") {
+                cube_file = value;
+            } else if (arg == "--telemetry") {
+                telemetry_file = value;
+            } else if (arg == "--model") {
+                model_path = value;
+            } else if (arg == "--save-model") {
+                save_model_path = value;
+            } else if (arg == "--iterations") {
+                if (!parse_number(value, iterations) || iterations < 0) {
+                    std::cerr << "--iterations needs a step count, not '" << value << "'" << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--strip-rows") {
+                if (!parse_number(value, strip_rows) || strip_rows <= 0) {
+                    std::cerr << "--strip-rows needs a positive row count, not '" << value << "'" << std::endl;
+                    return 1;
+                }
+            } else if (!parse_number(value, seconds) || seconds <= 0) {
+                std::cerr << "--seconds needs a positive time, not '" << value << "'" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        } else if (arg.compare(0, 2, "--") == 0) {
+            usage();
+            return 1;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+
+    if (!model_path.empty()) {
+        if (positional.size() != 2) {
+            usage();
+            return 1;
+        }
+        if (strip_rows > 0 && (!is_ppm(positional[0]) || !is_ppm(positional[1]))) {
+            std::cerr << "Streaming reads and writes PPM; give an input and output ending in .ppm" << std::endl;
+            return 1;
+        }
+        return apply_model(model_path, positional[0], positional[1], strip_rows, glsl_file, cube_file);
+    }
+
+    if (positional.size() != 3) {
+        usage();
+        return 1;
+    }
+
+    /* When streaming, the image is never loaded whole; the run only trains */
+    QImage image;
+    if (strip_rows > 0) {
+        if (!is_ppm(positional[0]) || !is_ppm(positional[2])) {
+            std::cerr << "Streaming reads and writes PPM; give an input and output ending in .ppm" << std::endl;
+            return 1;
+        }
+    } else if (!image.load(QString::fromStdString(positional[0]))) {
+        std::cerr << "Cannot load " << positional[0] << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<QColor, QColor>> cmap;
+    run_settings settings;
+    try {
+        load_mapping_file(positional[1], cmap, settings);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (iterations >= 0) {
+        settings.max_iterations = size_t(iterations);
+    }
+    if (seconds > 0) {
+        settings.time_budget = seconds;
+    }
+    if (settings.max_iterations == 0 && settings.time_budget <= 0 && settings.plateau_iterations == 0 && settings.min_gradient_norm <= 0) {
+        std::cerr << "Give an iteration count, --seconds or a stop line so training can end" << std::endl;
+        return 1;
+    }
+
+    std::ofstream telemetry;
+    if (!telemetry_file.empty()) {
+        telemetry.open(telemetry_file);
+        telemetry << "iteration,steps,error,min_error,max_error,gradient_norm,step_seconds" << std::endl;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    run_thread thread(image, cmap, settings);
+
+    std::vector<training_sample> samples;
+    uint64_t total_iterations = 0;
+    uint64_t total_steps = 0;
+    double total_step_seconds = 0;
+    auto drain = [&]() {
+        samples.clear();
+        thread.take_telemetry(samples);
+        for (const training_sample& sample : samples) {
+            if (telemetry.is_open()) {
+                telemetry << sample.iteration << "," << sample.steps << "," << sample.error << "," << sample.min_error << "," << sample.max_error << "," << sample.gradient_norm << "," << sample.step_seconds << "\n";
+            }
+            total_iterations = sample.iteration;
+            total_steps += sample.steps;
+            total_step_seconds += sample.step_seconds;
+        }
+    };
+
+    while (!thread.is_done()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        drain();
+    }
+
+    drain();
+    if (telemetry.is_open() && !telemetry) {
+        std::cerr << "Cannot write " << telemetry_file << std::endl;
+        return 1;
+    }
+
+    double pixels_per_second = thread.get_pixels_per_second();
+    if (strip_rows > 0) {
+        const std::atomic<bool> abort(false);
+        const auto stream_start = std::chrono::steady_clock::now();
+        try {
+            const double pixels = stream_apply(*thread.result_transform(), positional[0], positional[2], strip_rows, abort);
+            const std::chrono::duration<double> stream_elapsed = std::chrono::steady_clock::now() - stream_start;
+            pixels_per_second = pixels / std::max(stream_elapsed.count(), 1e-9);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    } else if (!thread.result().save(QString::fromStdString(positional[2]))) {
+        std::cerr << "Cannot write " << positional[2] << std::endl;
+        return 1;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!glsl_file.empty() && !write_text(glsl_file, thread.result_string())) {
+        std::cerr << "Cannot write " << glsl_file << std::endl;
+        return 1;
+    }
+    if (!cube_file.empty()) {
+        if (thread.result_cube().empty()) {
+            std::cerr << "No LUT was baked; add a 'lut' line to the mapping file" << std::endl;
+            return 1;
+        }
+        if (!write_text(cube_file, thread.result_cube())) {
+            std::cerr << "Cannot write " << cube_file << std::endl;
+            return 1;
+        }
+    }
+
+    if (!save_model_path.empty()) {
+        try {
+            save_model_file(save_model_path, thread.result_model());
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "last error: " << thread.get_last_error() << std::endl;
+    std::cout << "best error: " << thread.get_best_error() << std::endl;
+    std::cout << "iterations: " << total_iterations << " (" << thread.get_stop_reason() << ")" << std::endl;
+    if (total_steps > 0) {
+        std::cout << "mean step: " << total_step_seconds / total_steps * 1e6 << " us (" << total_steps / std::max(total_step_seconds, 1e-9) << " iterations/s)" << std::endl;
+    }
+    if (thread.get_dropped_telemetry() > 0) {
+        std::cout << "telemetry dropped: " << thread.get_dropped_telemetry() << std::endl;
+    }
+    std::cout << "total time: " << elapsed.count() << " s" << std::endl;
+    std::cout << "apply rate: " << pixels_per_second / 1e6 << " Mpixel/s" << std::endl;
+
+    if (glsl_file.empty()) {
+        std::cout << thread.result_string() << std::endl;
+    }
+
+    return 0;
+}
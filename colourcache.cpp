@@ -0,0 +1,65 @@
+#include "colourcache.h"
+#include <algorithm>
+
+colour_cache::colour_cache(const size_t max_colours) : max_colours_(std::min<size_t>(max_colours, size_t(1) << 24)) {
+    /* Start at 1024 slots; insert() doubles the table whenever another
+     * colour would take it past half full. max_colours is capped at the
+     * 2^24 colours there are, so the table never exceeds 2^25 slots. */
+    allocate(10);
+}
+
+void colour_cache::allocate(const unsigned bits) {
+    const size_t capacity = size_t(1) << bits;
+    mask_ = capacity - 1;
+    shift_ = 32 - bits;
+    keys_.assign(capacity, 0);
+    values_.resize(capacity);
+}
+
+void colour_cache::grow() {
+    allocate(32 - shift_ + 1);
+    for (size_t i = 0; i < colours_.size(); ++i) {
+        const uint32_t key = colours_[i] | occupied;
+        size_t slot = hash(key);
+        while (keys_[slot] != 0) {
+            slot = (slot + 1) & mask_;
+        }
+        keys_[slot] = key;
+        values_[slot] = uint32_t(i);
+    }
+}
+
+void colour_cache::evaluate(const pixel_transform& transform) {
+    const long count = long(colours_.size());
+    const long block = 1024;
+    results_.resize(colours_.size());
+
+    #pragma omp parallel
+    {
+        std::vector<float> red(block);
+        std::vector<float> green(block);
+        std::vector<float> blue(block);
+        const float* const input[] = { red.data(), green.data(), blue.data() };
+        float* const output[] = { red.data(), green.data(), blue.data() };
+
+        #pragma omp for schedule(dynamic)
+        for (long begin = 0; begin < count; begin += block) {
+            const long end = std::min(count, begin + block);
+            for (long i = begin; i < end; ++i) {
+                const uint32_t rgb = colours_[i];
+                red[i - begin] = ((rgb >> 16) & 0xff) / 255.0f;
+                green[i - begin] = ((rgb >> 8) & 0xff) / 255.0f;
+                blue[i - begin] = (rgb & 0xff) / 255.0f;
+            }
+
+            transform.apply(input, output, size_t(end - begin));
+
+            for (long i = begin; i < end; ++i) {
+                const uint32_t r = uint32_t(red[i - begin] * 255 + 0.5f);
+                const uint32_t g = uint32_t(green[i - begin] * 255 + 0.5f);
+                const uint32_t b = uint32_t(blue[i - begin] * 255 + 0.5f);
+                results_[i] = (r << 16) | (g << 8) | b;
+            }
+        }
+    }
+}
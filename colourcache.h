@@ -0,0 +1,85 @@
+#ifndef __COLOUR_CACHE_H__
+#define __COLOUR_CACHE_H__
+
+#include "pixeltransform.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Memoizes a pixel_transform over the distinct colours of an image.
+ *
+ * Colours are packed 0xRRGGBB and kept in an open-addressing hash table with
+ * linear probing. The table starts small and doubles as colours arrive, so
+ * memory follows the colours actually seen rather than max_colours. Once
+ * every colour is inserted, evaluate() runs the transform once per
+ * distinct colour and lookup() returns the mapped colour. */
+class colour_cache {
+public:
+    explicit colour_cache(const size_t max_colours);
+
+    size_t size() const {
+        return colours_.size();
+    }
+
+    /* Returns false, leaving the colour out, when the cache already holds
+     * max_colours distinct colours. */
+    bool insert(const uint32_t rgb) {
+        const uint32_t key = rgb | occupied;
+        size_t slot = hash(key);
+        while (keys_[slot] != 0) {
+            if (keys_[slot] == key) {
+                return true;
+            }
+            slot = (slot + 1) & mask_;
+        }
+        if (colours_.size() == max_colours_) {
+            return false;
+        }
+        /* Keep the load factor at or below one half */
+        if (2 * (colours_.size() + 1) > keys_.size()) {
+            grow();
+            slot = hash(key);
+            while (keys_[slot] != 0) {
+                slot = (slot + 1) & mask_;
+            }
+        }
+        keys_[slot] = key;
+        values_[slot] = uint32_t(colours_.size());
+        colours_.push_back(rgb);
+        return true;
+    }
+
+    /* Maps every cached colour through transform, in parallel. */
+    void evaluate(const pixel_transform& transform);
+
+    /* The mapped colour for rgb, which must have been inserted. */
+    uint32_t lookup(const uint32_t rgb) const {
+        const uint32_t key = rgb | occupied;
+        size_t slot = hash(key);
+        while (keys_[slot] != key) {
+            slot = (slot + 1) & mask_;
+        }
+        return results_[values_[slot]];
+    }
+
+private:
+    static const uint32_t occupied = 0x01000000; /* keeps black distinct from an empty slot */
+
+    size_t hash(const uint32_t key) const {
+        return size_t((key * 2654435761u) >> shift_) & mask_;
+    }
+
+    /* Doubles the table and reinserts every colour */
+    void grow();
+    void allocate(const unsigned bits);
+
+    size_t max_colours_;
+    size_t mask_;
+    unsigned shift_;
+    std::vector<uint32_t> keys_;
+    std::vector<uint32_t> values_;
+    std::vector<uint32_t> colours_;
+    std::vector<uint32_t> results_;
+};
+
+#endif /* __COLOUR_CACHE_H__ */
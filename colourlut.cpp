@@ -0,0 +1,210 @@
+#include "colourlut.h"
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOUR_LUT_X86
+#include <immintrin.h>
+#endif
+
+colour_lut::colour_lut() : size_(0), mode_(trilinear), avx2_(false) {
+}
+
+colour_lut::colour_lut(const pixel_transform& transform, const size_t size, const interpolation mode) : size_(size), mode_(mode), avx2_(false) {
+    if (size_ < 2) {
+        throw std::runtime_error("LUT needs at least two entries per axis");
+    }
+
+    const size_t entries = size_ * size_ * size_;
+    for (size_t c = 0; c < num_channels; ++c) {
+        table_[c].resize(entries);
+    }
+
+    /* Sample the grid with the transform itself, red changing fastest */
+    const float scale = 1.0f / float(size_ - 1);
+    for (size_t b = 0; b < size_; ++b) {
+        for (size_t g = 0; g < size_; ++g) {
+            for (size_t r = 0; r < size_; ++r) {
+                const size_t index = (b * size_ + g) * size_ + r;
+                table_[0][index] = r * scale;
+                table_[1][index] = g * scale;
+                table_[2][index] = b * scale;
+            }
+        }
+    }
+    const float* const input[] = { table_[0].data(), table_[1].data(), table_[2].data() };
+    float* const output[] = { table_[0].data(), table_[1].data(), table_[2].data() };
+    transform.apply(input, output, entries);
+
+#ifdef COLOUR_LUT_X86
+    __builtin_cpu_init();
+    avx2_ = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+void colour_lut::apply(const float* const input[num_channels], float* const output[num_channels], const size_t count) const {
+    size_t done = 0;
+    if (avx2_) {
+        done = apply_avx2(input, output, count);
+    }
+    apply_scalar(input, output, done, count);
+}
+
+void colour_lut::apply_scalar(const float* const input[num_channels], float* const output[num_channels], const size_t begin, const size_t end) const {
+    const size_t stride[] = { 1, size_, size_ * size_ };
+    const float scale = float(size_ - 1);
+    for (size_t i = begin; i < end; ++i) {
+        size_t base = 0;
+        float f[num_channels];
+        for (size_t c = 0; c < num_channels; ++c) {
+            const float x = std::min(1.0f, std::max(0.0f, input[c][i])) * scale;
+            const size_t cell = std::min(size_t(x), size_ - 2);
+            f[c] = x - cell;
+            base += cell * stride[c];
+        }
+
+        float result[num_channels];
+        if (mode_ == trilinear) {
+            for (size_t c = 0; c < num_channels; ++c) {
+                const float* t = table_[c].data() + base;
+                const float c00 = t[0] + f[0] * (t[1] - t[0]);
+                const float c10 = t[stride[1]] + f[0] * (t[stride[1] + 1] - t[stride[1]]);
+                const float c01 = t[stride[2]] + f[0] * (t[stride[2] + 1] - t[stride[2]]);
+                const float c11 = t[stride[2] + stride[1]] + f[0] * (t[stride[2] + stride[1] + 1] - t[stride[2] + stride[1]]);
+                const float c0 = c00 + f[1] * (c10 - c00);
+                const float c1 = c01 + f[1] * (c11 - c01);
+                result[c] = c0 + f[2] * (c1 - c0);
+            }
+        } else {
+            /* Walk from the near corner to the far one along the axes in
+             * order of decreasing fraction: w1 >= w2 >= w3. last is the
+             * smaller of the two axes that did not come first. */
+            const size_t first = (f[0] >= f[1] && f[0] >= f[2]) ? 0 : (f[1] >= f[2] ? 1 : 2);
+            const size_t other_a = (first == 0) ? 1 : 0;
+            const size_t other_b = (first == 2) ? 1 : 2;
+            const size_t last = (f[other_a] <= f[other_b]) ? other_a : other_b;
+            const float w1 = f[first];
+            const float w3 = f[last];
+            const float w2 = f[0] + f[1] + f[2] - w1 - w3;
+            const size_t corner_a = stride[first];
+            const size_t corner_b = stride[0] + stride[1] + stride[2] - stride[last];
+            const size_t corner_c = stride[0] + stride[1] + stride[2];
+            for (size_t c = 0; c < num_channels; ++c) {
+                const float* t = table_[c].data() + base;
+                result[c] = (1 - w1) * t[0] + (w1 - w2) * t[corner_a] + (w2 - w3) * t[corner_b] + w3 * t[corner_c];
+            }
+        }
+
+        for (size_t c = 0; c < num_channels; ++c) {
+            output[c][i] = std::min(1.0f, std::max(0.0f, result[c]));
+        }
+    }
+}
+
+std::string colour_lut::cube(const std::string& title) const {
+    std::stringstream ss;
+    ss << "TITLE \"" << title << "\"" << std::endl;
+    ss << "LUT_3D_SIZE " << size_ << std::endl;
+    ss << "DOMAIN_MIN 0.0 0.0 0.0" << std::endl;
+    ss << "DOMAIN_MAX 1.0 1.0 1.0" << std::endl;
+    ss << std::fixed << std::setprecision(6);
+    for (size_t i = 0; i < table_[0].size(); ++i) {
+        ss << table_[0][i] << " " << table_[1][i] << " " << table_[2][i] << std::endl;
+    }
+    return ss.str();
+}
+
+#ifdef COLOUR_LUT_X86
+
+__attribute__((target("avx2,fma")))
+size_t colour_lut::apply_avx2(const float* const input[num_channels], float* const output[num_channels], const size_t count) const {
+    const int n = int(size_);
+    const __m256 scale = _mm256_set1_ps(float(size_ - 1));
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256i last_cell = _mm256_set1_epi32(n - 2);
+    const __m256i stride[] = { _mm256_set1_epi32(1), _mm256_set1_epi32(n), _mm256_set1_epi32(n * n) };
+    const __m256i all_axes = _mm256_set1_epi32(1 + n + n * n);
+    const float* const t[] = { table_[0].data(), table_[1].data(), table_[2].data() };
+    const size_t width = 8;
+    size_t i = 0;
+    for (; i + width <= count; i += width) {
+        __m256i base = _mm256_setzero_si256();
+        __m256 f[num_channels];
+        for (size_t c = 0; c < num_channels; ++c) {
+            const __m256 x = _mm256_mul_ps(_mm256_min_ps(one, _mm256_max_ps(zero, _mm256_loadu_ps(input[c] + i))), scale);
+            const __m256i cell = _mm256_min_epi32(_mm256_cvttps_epi32(x), last_cell);
+            f[c] = _mm256_sub_ps(x, _mm256_cvtepi32_ps(cell));
+            base = _mm256_add_epi32(base, _mm256_mullo_epi32(cell, stride[c]));
+        }
+
+        __m256 result[num_channels];
+        if (mode_ == trilinear) {
+            const __m256i i000 = base;
+            const __m256i i010 = _mm256_add_epi32(base, stride[1]);
+            const __m256i i001 = _mm256_add_epi32(base, stride[2]);
+            const __m256i i011 = _mm256_add_epi32(i001, stride[1]);
+            for (size_t c = 0; c < num_channels; ++c) {
+                const __m256 t000 = _mm256_i32gather_ps(t[c], i000, 4);
+                const __m256 t100 = _mm256_i32gather_ps(t[c] + 1, i000, 4);
+                const __m256 t010 = _mm256_i32gather_ps(t[c], i010, 4);
+                const __m256 t110 = _mm256_i32gather_ps(t[c] + 1, i010, 4);
+                const __m256 t001 = _mm256_i32gather_ps(t[c], i001, 4);
+                const __m256 t101 = _mm256_i32gather_ps(t[c] + 1, i001, 4);
+                const __m256 t011 = _mm256_i32gather_ps(t[c], i011, 4);
+                const __m256 t111 = _mm256_i32gather_ps(t[c] + 1, i011, 4);
+                const __m256 c00 = _mm256_fmadd_ps(f[0], _mm256_sub_ps(t100, t000), t000);
+                const __m256 c10 = _mm256_fmadd_ps(f[0], _mm256_sub_ps(t110, t010), t010);
+                const __m256 c01 = _mm256_fmadd_ps(f[0], _mm256_sub_ps(t101, t001), t001);
+                const __m256 c11 = _mm256_fmadd_ps(f[0], _mm256_sub_ps(t111, t011), t011);
+                const __m256 c0 = _mm256_fmadd_ps(f[1], _mm256_sub_ps(c10, c00), c00);
+                const __m256 c1 = _mm256_fmadd_ps(f[1], _mm256_sub_ps(c11, c01), c01);
+                result[c] = _mm256_fmadd_ps(f[2], _mm256_sub_ps(c1, c0), c0);
+            }
+        } else {
+            /* Same corner selection as apply_scalar */
+            const __m256 r_first = _mm256_and_ps(_mm256_cmp_ps(f[0], f[1], _CMP_GE_OQ), _mm256_cmp_ps(f[0], f[2], _CMP_GE_OQ));
+            const __m256 g_first = _mm256_andnot_ps(r_first, _mm256_cmp_ps(f[1], f[2], _CMP_GE_OQ));
+            const __m256 w1 = _mm256_max_ps(f[0], _mm256_max_ps(f[1], f[2]));
+            const __m256 w3 = _mm256_min_ps(f[0], _mm256_min_ps(f[1], f[2]));
+            const __m256 w2 = _mm256_sub_ps(_mm256_add_ps(f[0], _mm256_add_ps(f[1], f[2])), _mm256_add_ps(w1, w3));
+
+            const __m256 sr = _mm256_castsi256_ps(stride[0]);
+            const __m256 sg = _mm256_castsi256_ps(stride[1]);
+            const __m256 sb = _mm256_castsi256_ps(stride[2]);
+            const __m256 last_if_r = _mm256_blendv_ps(sb, sg, _mm256_cmp_ps(f[1], f[2], _CMP_LE_OQ));
+            const __m256 last_if_g = _mm256_blendv_ps(sb, sr, _mm256_cmp_ps(f[0], f[2], _CMP_LE_OQ));
+            const __m256 last_if_b = _mm256_blendv_ps(sg, sr, _mm256_cmp_ps(f[0], f[1], _CMP_LE_OQ));
+            const __m256i first_stride = _mm256_castps_si256(_mm256_blendv_ps(_mm256_blendv_ps(sb, sg, g_first), sr, r_first));
+            const __m256i last_stride = _mm256_castps_si256(_mm256_blendv_ps(_mm256_blendv_ps(last_if_b, last_if_g, g_first), last_if_r, r_first));
+
+            const __m256i corner_a = _mm256_add_epi32(base, first_stride);
+            const __m256i corner_b = _mm256_sub_epi32(_mm256_add_epi32(base, all_axes), last_stride);
+            const __m256i corner_c = _mm256_add_epi32(base, all_axes);
+            const __m256 weight_0 = _mm256_sub_ps(one, w1);
+            const __m256 weight_a = _mm256_sub_ps(w1, w2);
+            const __m256 weight_b = _mm256_sub_ps(w2, w3);
+            for (size_t c = 0; c < num_channels; ++c) {
+                __m256 value = _mm256_mul_ps(weight_0, _mm256_i32gather_ps(t[c], base, 4));
+                value = _mm256_fmadd_ps(weight_a, _mm256_i32gather_ps(t[c], corner_a, 4), value);
+                value = _mm256_fmadd_ps(weight_b, _mm256_i32gather_ps(t[c], corner_b, 4), value);
+                result[c] = _mm256_fmadd_ps(w3, _mm256_i32gather_ps(t[c], corner_c, 4), value);
+            }
+        }
+
+        for (size_t c = 0; c < num_channels; ++c) {
+            _mm256_storeu_ps(output[c] + i, _mm256_min_ps(one, _mm256_max_ps(zero, result[c])));
+        }
+    }
+    return i;
+}
+
+#else
+
+size_t colour_lut::apply_avx2(const float* const[num_channels], float* const[num_channels], const size_t) const {
+    return 0;
+}
+
+#endif
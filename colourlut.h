@@ -0,0 +1,50 @@
+#ifndef __COLOUR_LUT_H__
+#define __COLOUR_LUT_H__
+
+#include "pixeltransform.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+/* A 3D lookup table sampled from another pixel_transform on a regular
+ * size x size x size grid over the unit cube. Lookups interpolate between
+ * the eight surrounding grid points (trilinear) or the four corners of the
+ * enclosing tetrahedron (tetrahedral), eight pixels at a time with AVX2
+ * gathers where the CPU supports it.
+ *
+ * Entries are ordered with red changing fastest, as in the .cube format. */
+class colour_lut : public pixel_transform {
+public:
+    enum interpolation {
+        trilinear,
+        tetrahedral
+    };
+
+    colour_lut();
+
+    colour_lut(const pixel_transform& transform, const size_t size, const interpolation mode);
+
+    size_t size() const {
+        return size_;
+    }
+
+    interpolation mode() const {
+        return mode_;
+    }
+
+    void apply(const float* const input[num_channels], float* const output[num_channels], const size_t count) const override;
+
+    /* The table in Adobe/Resolve .cube text format */
+    std::string cube(const std::string& title) const;
+
+private:
+    void apply_scalar(const float* const input[num_channels], float* const output[num_channels], const size_t begin, const size_t end) const;
+    size_t apply_avx2(const float* const input[num_channels], float* const output[num_channels], const size_t count) const;
+
+    size_t size_;
+    interpolation mode_;
+    std::vector<float> table_[num_channels];
+    bool avx2_;
+};
+
+#endif /* __COLOUR_LUT_H__ */
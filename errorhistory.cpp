@@ -0,0 +1,169 @@
+#include "errorhistory.h"
+#include <algorithm>
+#include <limits>
+
+error_history::error_history(const size_t capacity, const size_t num_levels) : capacity_(std::max<size_t>(capacity, 2)), levels_(std::max<size_t>(num_levels, 1)) {
+    for (level& l : levels_) {
+        l.bins.resize(capacity_);
+    }
+    overview_.reserve(capacity_ * 2);
+    clear();
+}
+
+void error_history::clear() {
+    for (level& l : levels_) {
+        l.head = 0;
+        l.count = 0;
+        l.samples = 0;
+        l.has_pending = false;
+    }
+    overview_.clear();
+    overview_width_ = 1;
+    overview_pending_.count = 0;
+    size_ = 0;
+    best_ = std::numeric_limits<double>::max();
+    last_ = 0;
+}
+
+error_bin error_history::merge(const error_bin& a, const error_bin& b) {
+    error_bin result;
+    result.count = a.count + b.count;
+    result.first = a.first;
+    result.last = b.last;
+    result.min = std::min(a.min, b.min);
+    result.max = std::max(a.max, b.max);
+    result.best = b.best;
+    return result;
+}
+
+void error_history::push(const double error) {
+    error_bin bin;
+    bin.count = 1;
+    bin.first = error;
+    bin.last = error;
+    bin.min = error;
+    bin.max = error;
+    push(bin);
+}
+
+void error_history::push(const error_bin& run) {
+    size_ += run.count;
+    last_ = run.last;
+    best_ = std::min(best_, run.min);
+
+    error_bin bin = run;
+    bin.best = best_;
+
+    add(0, bin);
+
+    overview_pending_ = overview_pending_.count == 0 ? bin : merge(overview_pending_, bin);
+    if (overview_pending_.count >= overview_width_) {
+        overview_.push_back(overview_pending_);
+        overview_pending_.count = 0;
+        if (overview_.size() == capacity_ * 2) {
+            for (size_t i = 0; i < capacity_; ++i) {
+                overview_[i] = merge(overview_[i * 2], overview_[i * 2 + 1]);
+            }
+            overview_.resize(capacity_);
+            overview_width_ *= 2;
+        }
+    }
+}
+
+void error_history::add(const size_t index, const error_bin& bin) {
+    level& l = levels_[index];
+    if (l.count == capacity_) {
+        l.samples -= l.bins[l.head].count;
+    }
+    l.samples += bin.count;
+    l.bins[l.head] = bin;
+    l.head = (l.head + 1) % capacity_;
+    l.count = std::min(l.count + 1, capacity_);
+
+    if (index + 1 < levels_.size()) {
+        level& up = levels_[index + 1];
+        if (up.has_pending) {
+            up.has_pending = false;
+            add(index + 1, merge(up.pending, bin));
+        } else {
+            up.pending = bin;
+            up.has_pending = true;
+        }
+    }
+}
+
+uint64_t error_history::covered(const size_t index) const {
+    uint64_t samples = levels_[index].samples;
+    for (size_t j = 1; j <= index; ++j) {
+        if (levels_[j].has_pending) {
+            samples += levels_[j].pending.count;
+        }
+    }
+    return samples;
+}
+
+void error_history::query(const uint64_t span, const size_t columns, std::vector<error_bin>& out) const {
+    out.clear();
+    if (size_ == 0 || columns == 0) {
+        return;
+    }
+    const uint64_t samples = (span == 0 || span > size_) ? size_ : span;
+
+    size_t index = 0;
+    while (index < levels_.size() && covered(index) < samples) {
+        index++;
+    }
+
+    /* Source bins, oldest first, with the partly filled bin last */
+    std::vector<error_bin> source;
+    source.reserve(capacity_ * 2 + 1);
+    if (index < levels_.size()) {
+        const level& l = levels_[index];
+        error_bin tail;
+        tail.count = 0;
+        for (size_t j = index; j >= 1; --j) {
+            if (levels_[j].has_pending) {
+                tail = tail.count == 0 ? levels_[j].pending : merge(tail, levels_[j].pending);
+            }
+        }
+        uint64_t taken = tail.count;
+        size_t taken_bins = 0;
+        while (taken < samples && taken_bins < l.count) {
+            taken += l.bins[(l.head + capacity_ - 1 - taken_bins) % capacity_].count;
+            taken_bins++;
+        }
+        for (size_t i = taken_bins; i > 0; --i) {
+            source.push_back(l.bins[(l.head + capacity_ - i) % capacity_]);
+        }
+        if (tail.count != 0) {
+            source.push_back(tail);
+        }
+    } else {
+        uint64_t taken = overview_pending_.count;
+        size_t first = overview_.size();
+        while (taken < samples && first > 0) {
+            first--;
+            taken += overview_[first].count;
+        }
+        source.assign(overview_.begin() + long(first), overview_.end());
+        if (overview_pending_.count != 0) {
+            source.push_back(overview_pending_);
+        }
+    }
+
+    if (source.size() <= columns) {
+        out.swap(source);
+        return;
+    }
+
+    out.reserve(columns);
+    for (size_t c = 0; c < columns; ++c) {
+        const size_t begin = source.size() * c / columns;
+        const size_t end = source.size() * (c + 1) / columns;
+        error_bin bin = source[begin];
+        for (size_t i = begin + 1; i < end; ++i) {
+            bin = merge(bin, source[i]);
+        }
+        out.push_back(bin);
+    }
+}
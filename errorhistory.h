@@ -0,0 +1,81 @@
+#ifndef __ERROR_HISTORY_H__
+#define __ERROR_HISTORY_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* Summary of a run of consecutive error samples. */
+struct error_bin {
+    uint64_t count;
+    double first;
+    double last;
+    double min;
+    double max;
+    double best; /* lowest error seen up to the end of the bin */
+};
+
+/* Fixed memory record of a training error curve.
+ *
+ * Samples arrive singly or as runs already summarised into a bin. Level k
+ * keeps the most recent capacity bins of 2^k arrivals each in a ring, so
+ * recent history can be shown at full detail and older history at
+ * progressively coarser detail. An overview of the whole run is kept
+ * separately in at most 2 * capacity bins whose width doubles each time it
+ * fills. Adding costs amortised O(1) and memory never grows. */
+class error_history {
+public:
+    explicit error_history(const size_t capacity = 1024, const size_t num_levels = 12);
+
+    void clear();
+
+    void push(const double error);
+
+    /* Adds a run of run.count consecutive samples; its best is ignored */
+    void push(const error_bin& run);
+
+    uint64_t size() const {
+        return size_;
+    }
+
+    double best() const {
+        return best_;
+    }
+
+    double last() const {
+        return last_;
+    }
+
+    /* Summarises the last span samples (all of them if span is 0) into at
+     * most columns bins, oldest first, taken from the finest level that
+     * still covers span. Runs in time proportional to capacity. */
+    void query(const uint64_t span, const size_t columns, std::vector<error_bin>& out) const;
+
+private:
+    struct level {
+        std::vector<error_bin> bins; /* ring of completed bins */
+        size_t head; /* next slot to write */
+        size_t count; /* completed bins held, at most capacity */
+        uint64_t samples; /* samples in the completed bins held */
+        error_bin pending; /* a completed bin of the level below awaiting its pair */
+        bool has_pending;
+    };
+
+    static error_bin merge(const error_bin& a, const error_bin& b);
+
+    void add(const size_t index, const error_bin& bin);
+
+    /* Samples held by level index, including those still on their way up */
+    uint64_t covered(const size_t index) const;
+
+    size_t capacity_;
+    std::vector<level> levels_;
+    std::vector<error_bin> overview_;
+    uint64_t overview_width_;
+    error_bin overview_pending_;
+    uint64_t size_;
+    double best_;
+    double last_;
+};
+
+#endif /* __ERROR_HISTORY_H__ */
@@ -0,0 +1,41 @@
+#include "fixednetwork.h"
+
+namespace {
+
+struct fixed_network_entry {
+    size_t in;
+    size_t hidden;
+    size_t out;
+    fixed_network_kernel kernel;
+};
+
+template <size_t In, size_t Hidden, size_t Out>
+fixed_network_entry entry() {
+    fixed_network_entry result;
+    result.in = In;
+    result.hidden = Hidden;
+    result.out = Out;
+    result.kernel.error = &fixed_network<In, Hidden, Out>::error;
+    result.kernel.gradient = &fixed_network<In, Hidden, Out>::gradient;
+    return result;
+}
+
+/* The standard topologies; add an entry here to precompile another */
+const fixed_network_entry entries[] = {
+    entry<3, 4, 3>(),
+    entry<3, 8, 3>()
+};
+
+}
+
+const fixed_network_kernel* find_fixed_network(const std::vector<size_t>& widths) {
+    if (widths.size() != 3) {
+        return nullptr;
+    }
+    for (const fixed_network_entry& e : entries) {
+        if (widths[0] == e.in && widths[1] == e.hidden && widths[2] == e.out) {
+            return &e.kernel;
+        }
+    }
+    return nullptr;
+}
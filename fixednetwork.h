@@ -0,0 +1,110 @@
+#ifndef __FIXED_NETWORK_H__
+#define __FIXED_NETWORK_H__
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+/* A dense_network whose layer widths are known at compile time: In inputs,
+ * one tanh hidden layer of Hidden units and Out linear outputs. Every loop
+ * has a constant trip count, so the compiler unrolls the whole forward and
+ * backward pass and keeps the activations in registers.
+ *
+ * The parameters use exactly the dense_network layout, so the same flat
+ * vector can be handed to either implementation. */
+template <size_t In, size_t Hidden, size_t Out>
+struct fixed_network {
+    enum : size_t {
+        output_offset = Hidden * (In + 1),
+        num_parameters = output_offset + Out * (Hidden + 1)
+    };
+
+    /* Squared error summed over count samples */
+    static double error(const double* parameters, const double* inputs, const double* targets, const size_t count) {
+        double error = 0;
+        for (size_t n = 0; n < count; ++n) {
+            double h[Hidden];
+            double z[Out];
+            forward(parameters, inputs + n * In, h, z);
+            for (size_t o = 0; o < Out; ++o) {
+                const double difference = z[o] - targets[n * Out + o];
+                error += difference * difference;
+            }
+        }
+        return error;
+    }
+
+    /* Adds the gradient of the squared error over count samples to
+     * gradient and returns the error, like dense_network::backward(). */
+    static double gradient(const double* parameters, const double* inputs, const double* targets, const size_t count, double* gradient) {
+        double error = 0;
+        for (size_t n = 0; n < count; ++n) {
+            const double* x = inputs + n * In;
+            double h[Hidden];
+            double z[Out];
+            forward(parameters, x, h, z);
+
+            /* d/dz (z - t)^2 = 2(z - t) */
+            double dz[Out];
+            for (size_t o = 0; o < Out; ++o) {
+                const double difference = z[o] - targets[n * Out + o];
+                error += difference * difference;
+                dz[o] = 2 * difference;
+            }
+
+            double dh[Hidden] = {};
+            for (size_t o = 0; o < Out; ++o) {
+                const double* w = parameters + output_offset + o * (Hidden + 1);
+                double* g = gradient + output_offset + o * (Hidden + 1);
+                for (size_t k = 0; k < Hidden; ++k) {
+                    g[k] += dz[o] * h[k];
+                    dh[k] += dz[o] * w[k];
+                }
+                g[Hidden] += dz[o];
+            }
+
+            /* d/dx tanh(x) = 1 - tanh^2(x) */
+            for (size_t k = 0; k < Hidden; ++k) {
+                const double d = dh[k] * (1 - h[k] * h[k]);
+                double* g = gradient + k * (In + 1);
+                for (size_t j = 0; j < In; ++j) {
+                    g[j] += d * x[j];
+                }
+                g[In] += d;
+            }
+        }
+        return error;
+    }
+
+private:
+    static void forward(const double* parameters, const double* x, double* h, double* z) {
+        for (size_t k = 0; k < Hidden; ++k) {
+            const double* w = parameters + k * (In + 1);
+            double acc = w[In];
+            for (size_t j = 0; j < In; ++j) {
+                acc += w[j] * x[j];
+            }
+            h[k] = std::tanh(acc);
+        }
+        for (size_t o = 0; o < Out; ++o) {
+            const double* w = parameters + output_offset + o * (Hidden + 1);
+            double acc = w[Hidden];
+            for (size_t k = 0; k < Hidden; ++k) {
+                acc += w[k] * h[k];
+            }
+            z[o] = acc;
+        }
+    }
+};
+
+/* Entry points of one precompiled fixed_network instantiation. */
+struct fixed_network_kernel {
+    double (*error)(const double* parameters, const double* inputs, const double* targets, const size_t count);
+    double (*gradient)(const double* parameters, const double* inputs, const double* targets, const size_t count, double* gradient);
+};
+
+/* The precompiled kernel for a network of the given widths, or nullptr
+ * when there is none and the generic dense_network has to be used. */
+const fixed_network_kernel* find_fixed_network(const std::vector<size_t>& widths);
+
+#endif /* __FIXED_NETWORK_H__ */
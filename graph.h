@@ -1,272 +1,616 @@
+/* Expression graph engine with reverse-mode gradients.
+ *
+ * Training and applying now go through dense_network, fixed_network and
+ * pixel_kernel; this header is kept only as the reference path that
+ * qtmixer-bench measures them against, and is built by that target alone. */
+
 #include <iostream>
 #include <memory>
-#include <set>
-#include <deque>
 #include <map>
+#include <tuple>
 #include <cmath>
+#include <cstring>
 #include <vector>
+#include <limits>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
 #include <QImage>
 #include <QColor>
 
-class graph_node {
-public:
-  virtual ~graph_node() = default;
+enum class graph_opcode : uint8_t {
+  add,
+  sub,
+  mul,
+  sqrt,
+  tanh
 };
 
-class graph_variable : public graph_node {
-public:
-};
-
-class graph_binary : public graph_node {
-public:
-  graph_binary(const std::shared_ptr<graph_node>& lhs, const std::shared_ptr<graph_node> rhs) : lhs_(lhs), rhs_(rhs) {
-  }
-  std::shared_ptr<graph_node> left() const {
-    return lhs_;
-  }
-  std::shared_ptr<graph_node> right() const {
-    return rhs_;
-  }
-  virtual double evaluate(const double lhs_value, const double rhs_value) = 0;
-private:
-  std::shared_ptr<graph_node> lhs_;
-  std::shared_ptr<graph_node> rhs_;
-};
-
-class graph_add : public graph_binary {
-public:
-  graph_add(const std::shared_ptr<graph_node>& lhs, const std::shared_ptr<graph_node> rhs) : graph_binary(lhs, rhs) {
-  }
-  double evaluate(const double lhs_value, const double rhs_value) override {
-    return lhs_value + rhs_value;
-  }
-};
+typedef uint32_t graph_handle;
 
-class graph_sub : public graph_binary {
-public:
-  graph_sub(const std::shared_ptr<graph_node>& lhs, const std::shared_ptr<graph_node> rhs) : graph_binary(lhs, rhs) {
-  }
-  double evaluate(const double lhs_value, const double rhs_value) override {
-    return lhs_value - rhs_value;
-  }
-};
+/* The value of an operation; rhs is ignored by unary operations. */
+template <typename T>
+inline T graph_apply(const graph_opcode op, const T lhs, const T rhs) {
+  switch (op) {
+  case graph_opcode::add:
+    return lhs + rhs;
+  case graph_opcode::sub:
+    return lhs - rhs;
+  case graph_opcode::mul:
+    return lhs * rhs;
+  case graph_opcode::sqrt:
+    return std::sqrt(lhs);
+  case graph_opcode::tanh:
+    return std::tanh(lhs);
+  }
+  return 0;
+}
 
-class graph_mul : public graph_binary {
-public:
-  graph_mul(const std::shared_ptr<graph_node>& lhs, const std::shared_ptr<graph_node> rhs) : graph_binary(lhs, rhs) {
-  }
-  double evaluate(const double lhs_value, const double rhs_value) override {
-    return lhs_value * rhs_value;
-  }
+/* A node in a graph_arena. Variables (constants and parameters) have no
+ * operands; unary nodes use lhs only. */
+struct graph_node {
+  uint8_t arity; /* 0 for variables, 1 for unary and 2 for binary nodes */
+  uint8_t constant; /* variables only: a fixed value rather than a parameter */
+  graph_opcode op;
+  graph_handle lhs;
+  graph_handle rhs;
 };
 
-class graph_unary : public graph_node {
+/* Contiguous storage for every node of a graph, addressed by 32-bit
+ * handles. A node can only refer to nodes created before it, so handle
+ * order is always a topological order and a graph can be walked with a
+ * linear scan instead of a stack. All nodes are released together when
+ * the arena goes away. */
+class graph_arena {
 public:
-  graph_unary(const std::shared_ptr<graph_node>& input) : input_(input) {
-  }
-  std::shared_ptr<graph_node> input() const {
-    return input_;
+  graph_handle variable(const bool constant) {
+    const graph_handle handle = push(0, graph_opcode::add, 0, 0);
+    nodes_[handle].constant = constant;
+    return handle;
+  }
+  graph_handle unary(const graph_opcode op, const graph_handle input) {
+    return push(1, op, input, input);
+  }
+  graph_handle binary(const graph_opcode op, const graph_handle lhs, const graph_handle rhs) {
+    return push(2, op, lhs, rhs);
+  }
+  const graph_node& node(const graph_handle handle) const {
+    return nodes_[handle];
+  }
+  size_t size() const {
+    return nodes_.size();
+  }
+  /* Marks every node that root depends on, root included. */
+  void reachable(const graph_handle root, std::vector<uint8_t>& marks) const {
+    marks.assign(size_t(root) + 1, 0);
+    marks[root] = 1;
+    propagate(marks);
+  }
+  /* Marks every node that any of roots depends on. marks covers handles
+   * up to the last root. */
+  void reachable(const std::vector<graph_handle>& roots, std::vector<uint8_t>& marks) const {
+    const graph_handle last = *std::max_element(std::begin(roots), std::end(roots));
+    marks.assign(size_t(last) + 1, 0);
+    for (const graph_handle root : roots) {
+      marks[root] = 1;
+    }
+    propagate(marks);
   }
-  virtual double evaluate(const double value) = 0;
-  virtual double evaluate_delta(const double value) = 0;
 private:
-  std::shared_ptr<graph_node> input_;
-};
-
-class graph_sqrt : public graph_unary {
-public:
-  graph_sqrt(const std::shared_ptr<graph_node>& input) : graph_unary(input) {
-  }
-  double evaluate(const double value) override {
-    return sqrt(value);
-  }
-  double evaluate_delta(const double value) override {
-    /* d/dx x^(1/2) = (1/2) x^(-1/2) */
-    return 1 / (2 * sqrt(value));
-  }
-};
-
-class graph_tanh : public graph_unary {
-public:
-  graph_tanh(const std::shared_ptr<graph_node>& input) : graph_unary(input) {
-  }
-  double evaluate(const double value) override {
-    return tanh(value);
-  }
-  double evaluate_delta(const double value) override {
-    /* d/dx tanh(x) = 1 - tanh^2(x) */
-    return 1 - tanh(value) * tanh(value);
+  void propagate(std::vector<uint8_t>& marks) const {
+    for (size_t h = marks.size(); h-- > 0;) {
+      if (marks[h] && nodes_[h].arity != 0) {
+        marks[nodes_[h].lhs] = 1;
+        marks[nodes_[h].rhs] = 1;
+      }
+    }
   }
+  graph_handle push(const uint8_t arity, const graph_opcode op, const graph_handle lhs, const graph_handle rhs) {
+    if (nodes_.size() >= std::numeric_limits<graph_handle>::max()) {
+      throw std::runtime_error("Graph has too many nodes");
+    }
+    graph_node node;
+    node.arity = arity;
+    node.constant = 0;
+    node.op = op;
+    node.lhs = lhs;
+    node.rhs = rhs;
+    nodes_.push_back(node);
+    return graph_handle(nodes_.size() - 1);
+  }
+  std::vector<graph_node> nodes_;
 };
 
+/* A handle to a node together with the arena it lives in, so that
+ * expressions can be written with ordinary operators. */
 class graph_builder {
 public:
-  graph_builder() {
+  graph_builder() : arena_(nullptr), handle_(0) {
   }
-  graph_builder(const std::shared_ptr<graph_node>& node) : root_(node) {
+  graph_builder(graph_arena* arena, const graph_handle handle) : arena_(arena), handle_(handle) {
   }
   bool empty() const {
-    return !root_;
+    return arena_ == nullptr;
   }
-  std::shared_ptr<graph_node> root() const {
-    return root_;
+  graph_handle handle() const {
+    return handle_;
   }
   graph_builder operator +(const graph_builder& rhs) const {
-    return graph_builder(std::make_shared<graph_add>(root(), rhs.root()));
+    return graph_builder(arena_, arena_->binary(graph_opcode::add, handle_, rhs.handle_));
   }
   graph_builder operator -(const graph_builder& rhs) const {
-    return graph_builder(std::make_shared<graph_sub>(root(), rhs.root()));
+    return graph_builder(arena_, arena_->binary(graph_opcode::sub, handle_, rhs.handle_));
   }
   graph_builder operator *(const graph_builder& rhs) const {
-    return graph_builder(std::make_shared<graph_mul>(root(), rhs.root()));
+    return graph_builder(arena_, arena_->binary(graph_opcode::mul, handle_, rhs.handle_));
   }
   static graph_builder sqrt(const graph_builder& input) {
-    return graph_builder(std::make_shared<graph_sqrt>(input.root()));
+    return graph_builder(input.arena_, input.arena_->unary(graph_opcode::sqrt, input.handle_));
   }
   static graph_builder tanh(const graph_builder& input) {
-    return graph_builder(std::make_shared<graph_tanh>(input.root()));
+    return graph_builder(input.arena_, input.arena_->unary(graph_opcode::tanh, input.handle_));
   }
 private:
-  std::shared_ptr<graph_node> root_;
+  graph_arena* arena_;
+  graph_handle handle_;
 };
 
-class graph_evaluator {
+/* Builds graphs and evaluates them directly, holding values of type T. */
+template <typename T>
+class basic_graph_evaluator {
 public:
-  graph_builder constant(const double value) {
-    std::shared_ptr<graph_variable> variable = std::make_shared<graph_variable>();
-    values_.emplace(variable, value);
-    return graph_builder(variable);
+  basic_graph_evaluator() : arena_(std::make_shared<graph_arena>()) {
+  }
+  const graph_arena& arena() const {
+    return *arena_;
+  }
+  /* A fixed value. Compiled programs fold constants into the operations
+   * that use them; use parameter() for anything that changes. */
+  graph_builder constant(const T value) {
+    return variable(true, value);
   }
   graph_builder parameter() {
-    std::shared_ptr<graph_variable> variable = std::make_shared<graph_variable>();
-    values_.emplace(variable, 0.0);
-    return graph_builder(variable);
+    return variable(false, 0.0);
+  }
+  /* Copies share the arena, so a variable added through one copy may be
+   * beyond the values another holds; it reads as 0 there until set */
+  T get_parameter(const graph_builder& graph) const {
+    return value(variable(graph));
+  }
+  void set_parameter(const graph_builder& parameter, const T value) {
+    const graph_handle handle = variable(parameter);
+    values_.resize(arena_->size());
+    values_[handle] = value;
+  }
+  T evaluate(const graph_builder& graph) {
+    arena_->reachable(graph.handle(), marks_);
+    compute();
+    return values_[graph.handle()];
+  }
+  /* Evaluates several outputs at once, computing only the nodes that at
+   * least one of them depends on. */
+  void evaluate(const std::vector<graph_builder>& outputs, std::vector<T>& results) {
+    std::vector<graph_handle> roots(outputs.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      roots[i] = outputs[i].handle();
+    }
+    arena_->reachable(roots, marks_);
+    compute();
+    results.resize(roots.size());
+    for (size_t i = 0; i < roots.size(); ++i) {
+      results[i] = values_[roots[i]];
+    }
   }
-  double get_parameter(const graph_builder& graph) const {
-    auto map_item = values_.find(graph.root());
-    if (map_item == std::end(values_)) {
-      throw std::runtime_error("Parameter is not registered");
+  /* Forward-mode derivative of graph with respect to parameter, using the
+   * values from the last call to evaluate(). */
+  T evaluate_delta(const graph_builder& graph, const graph_builder& parameter) const {
+    const graph_handle root = graph.handle();
+    std::vector<uint8_t> marks;
+    arena_->reachable(root, marks);
+    std::vector<T> deltas(size_t(root) + 1, 0.0);
+    T* d = deltas.data();
+    if (parameter.handle() <= root) {
+      d[parameter.handle()] = 1; /* d/dx x = 1 */
+    }
+    for (graph_handle h = 0; h <= root; ++h) {
+      const graph_node& node = arena_->node(h);
+      if (!marks[h] || node.arity == 0) {
+        continue; /* d/dx y = 0 for every other variable */
+      }
+      switch (node.op) {
+      case graph_opcode::add:
+        /* d/dx (f(x) + g(x)) = d/dx f(x) + d/dx g(x) */
+        d[h] = d[node.lhs] + d[node.rhs];
+        break;
+      case graph_opcode::sub:
+        /* d/dx (f(x) - g(x)) = d/dx f(x) - d/dx g(x) */
+        d[h] = d[node.lhs] - d[node.rhs];
+        break;
+      case graph_opcode::mul:
+        /* d/dx (f(x) * g(x)) = f(x)g'(x) + f'(x)g(x) */
+        d[h] = value(node.lhs) * d[node.rhs] + d[node.lhs] * value(node.rhs);
+        break;
+      case graph_opcode::sqrt:
+        /* d/dx x^(1/2) = (1/2) x^(-1/2), reusing the forward value */
+        d[h] = d[node.lhs] / (2 * value(h));
+        break;
+      case graph_opcode::tanh:
+        /* d/dx tanh(x) = 1 - tanh^2(x), reusing the forward value */
+        d[h] = (1 - value(h) * value(h)) * d[node.lhs];
+        break;
+      }
     }
-    return map_item->second;
+    return d[root];
+  }
+  /* Value of any node as of the last evaluate(), or its value if it is a
+   * variable */
+  T value(const graph_handle node) const {
+    return node < values_.size() ? values_[node] : 0.0;
   }
-  void set_parameter(const graph_builder& parameter, const double value) {
-    auto map_item = values_.find(parameter.root());
-    if (map_item == std::end(values_)) {
+  std::vector<T> gradient(const graph_builder& graph, const std::vector<graph_builder>& parameters) const;
+private:
+  /* Computes every node marked in marks_, in handle order */
+  void compute() {
+    values_.resize(arena_->size());
+    T* v = values_.data();
+    for (graph_handle h = 0; h < marks_.size(); ++h) {
+      const graph_node& node = arena_->node(h);
+      if (marks_[h] && node.arity != 0) {
+        v[h] = graph_apply(node.op, v[node.lhs], v[node.rhs]);
+      }
+    }
+  }
+  graph_builder variable(const bool constant, const T value) {
+    const graph_handle handle = arena_->variable(constant);
+    values_.resize(arena_->size());
+    values_[handle] = value;
+    return graph_builder(arena_.get(), handle);
+  }
+  graph_handle variable(const graph_builder& graph) const {
+    if (graph.empty() || graph.handle() >= arena_->size() || arena_->node(graph.handle()).arity != 0) {
       throw std::runtime_error("Parameter is not registered");
     }
-    map_item->second = value;
+    return graph.handle();
   }
-  double evaluate(const graph_builder& graph) {
-    std::map<std::shared_ptr<graph_node>, double> new_values;
-    for (auto value : values_) {
-      if (std::dynamic_pointer_cast<graph_variable>(value.first)) {
-        new_values.emplace(value.first, value.second);
-      }
+  /* Shared so that builders, which point at the arena, stay valid when
+   * the evaluator is copied or moved */
+  std::shared_ptr<graph_arena> arena_;
+  std::vector<T> values_; /* indexed by handle */
+  std::vector<uint8_t> marks_;
+};
+
+struct graph_instruction {
+  graph_opcode op;
+  uint32_t out;
+  uint32_t lhs;
+  uint32_t rhs; /* unused by unary instructions */
+};
+
+/* A graph compiled into a flat instruction tape. Every node reachable from
+ * the outputs is given a slot in a dense value buffer and the operations are
+ * stored in topological order, so evaluation is a single linear pass over
+ * the tape with no allocation and no lookups. Slots are resolved once with
+ * slot() and then addressed directly from the hot loop.
+ *
+ * Compilation also simplifies the graph: operations on constants are
+ * folded, x + 0, x - 0 and x * 1 are reduced to x, identical operations on
+ * the same operands share one instruction, and anything no output needs
+ * is dropped. Constants are fixed once compiled; only parameters can be
+ * changed through set_parameter() and set_value().
+ *
+ * Values are held as T whatever the evaluator used, so a graph trained in
+ * double can be compiled into a float program for inference. */
+template <typename T>
+class basic_graph_program {
+public:
+  basic_graph_program() {
+  }
+  template <typename U>
+  basic_graph_program(const basic_graph_evaluator<U>& bp, const graph_builder& graph) : basic_graph_program(bp, std::vector<graph_builder>(1, graph)) {
+  }
+  /* Compiles only what outputs depend on, so a network's outputs can be
+   * compiled without the loss built on top of them. The first output is
+   * the root that evaluate(), evaluate_delta() and gradient() refer to. */
+  template <typename U>
+  basic_graph_program(const basic_graph_evaluator<U>& bp, const std::vector<graph_builder>& outputs) {
+    if (outputs.empty()) {
+      throw std::runtime_error("Cannot compile an empty graph");
     }
-    values_ = new_values;
-    std::deque<std::shared_ptr<graph_node>> stack;
-    stack.push_back(graph.root());
-    while (!stack.empty()) {
-      std::shared_ptr<graph_node> top = stack.back();
-      if (std::dynamic_pointer_cast<graph_variable>(top)) {
-        stack.pop_back();
-      } else if (std::dynamic_pointer_cast<graph_unary>(top)) {
-        std::shared_ptr<graph_unary> unary = std::dynamic_pointer_cast<graph_unary>(top);
-        auto input_item = values_.find(unary->input());
-        if (input_item == std::end(values_)) {
-          stack.push_back(unary->input());
-        } else {
-          stack.pop_back();
-          values_[unary] = unary->evaluate(input_item->second);
-        }
-      } else if (std::dynamic_pointer_cast<graph_binary>(top)) {
-        std::shared_ptr<graph_binary> binary = std::dynamic_pointer_cast<graph_binary>(top);
-        auto lhs_item = values_.find(binary->left());
-        auto rhs_item = values_.find(binary->right());
-        if ((lhs_item == std::end(values_)) && (rhs_item == std::end(values_))) {
-          stack.push_back(binary->left());
-          stack.push_back(binary->right());
-        } else if (lhs_item == std::end(values_)) {
-          stack.push_back(binary->left());
-        } else if (rhs_item == std::end(values_)) {
-          stack.push_back(binary->right());
-        } else {
-          stack.pop_back();
-          values_[binary] = binary->evaluate(lhs_item->second, rhs_item->second);
-        }
+    std::vector<graph_handle> roots(outputs.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+      if (outputs[i].empty()) {
+        throw std::runtime_error("Cannot compile an empty graph");
       }
+      roots[i] = outputs[i].handle();
     }
-    return values_[graph.root()];
-  }
-  double evaluate_delta(const graph_builder& graph, const graph_builder& parameter) const {
-    std::map<std::shared_ptr<graph_node>, double> deltas;
-    std::deque<std::shared_ptr<graph_node>> stack;
-    stack.push_back(graph.root());
-    while (!stack.empty()) {
-      std::shared_ptr<graph_node> top = stack.back();
-      if (std::dynamic_pointer_cast<graph_variable>(top)) {
-        stack.pop_back();
-        if (top == parameter.root()) {
-          deltas[top] = 1; /* d/dx x = 1 */
-        } else {
-          deltas[top] = 0; /* d/dx y = 0 */
+    const graph_arena& arena = bp.arena();
+    std::vector<uint8_t> marks;
+    arena.reachable(roots, marks);
+
+    std::vector<uint8_t> known; /* by slot: a constant fixed at compile time */
+    std::vector<uint8_t> pinned; /* by slot: a parameter, kept even if unused */
+    std::map<uint64_t, uint32_t> constants;
+    std::map<std::tuple<graph_opcode, uint32_t, uint32_t>, uint32_t> expressions;
+    auto leaf = [&](const T value, const bool constant) {
+      uint64_t bits = 0;
+      std::memcpy(&bits, &value, sizeof(value));
+      if (constant) {
+        auto item = constants.find(bits);
+        if (item != std::end(constants)) {
+          return item->second;
         }
-      } else if (std::dynamic_pointer_cast<graph_unary>(top)) {
-        std::shared_ptr<graph_unary> unary = std::dynamic_pointer_cast<graph_unary>(top);
-        auto input_item = deltas.find(unary->input());
-        if (input_item == std::end(deltas)) {
-          stack.push_back(unary->input());
-        } else {
-          stack.pop_back();
-          /* d/dx f(g(x)) = f'(g(x))g'(x) */
-          deltas[unary] += unary->evaluate_delta(get_value(unary->input())) * deltas[unary->input()];
+      }
+      const uint32_t slot = uint32_t(values_.size());
+      values_.push_back(value);
+      known.push_back(constant);
+      pinned.push_back(!constant);
+      if (constant) {
+        constants.emplace(bits, slot);
+      }
+      return slot;
+    };
+
+    /* Handle order is topological, so one forward scan schedules the tape */
+    slots_.assign(marks.size(), uint32_t(unscheduled));
+    for (graph_handle h = 0; h < marks.size(); ++h) {
+      if (!marks[h]) {
+        continue;
+      }
+      const graph_node& node = arena.node(h);
+      if (node.arity == 0) {
+        slots_[h] = leaf(T(bp.value(h)), node.constant != 0);
+        continue;
+      }
+      uint32_t lhs = slots_[node.lhs];
+      uint32_t rhs = slots_[node.rhs];
+      if (known[lhs] && known[rhs]) {
+        slots_[h] = leaf(graph_apply(node.op, values_[lhs], values_[rhs]), true);
+        continue;
+      }
+      const bool commutative = node.op == graph_opcode::add || node.op == graph_opcode::mul;
+      if (node.op == graph_opcode::add || node.op == graph_opcode::sub || node.op == graph_opcode::mul) {
+        const T identity = node.op == graph_opcode::mul ? 1 : 0;
+        if (known[rhs] && values_[rhs] == identity) {
+          slots_[h] = lhs;
+          continue;
         }
-      } else if (std::dynamic_pointer_cast<graph_binary>(top)) {
-        std::shared_ptr<graph_binary> binary = std::dynamic_pointer_cast<graph_binary>(top);
-        auto lhs_item = deltas.find(binary->left());
-        auto rhs_item = deltas.find(binary->right());
-        if ((lhs_item == std::end(deltas)) && (rhs_item == std::end(deltas))) {
-          stack.push_back(binary->left());
-          stack.push_back(binary->right());
-        } else if (lhs_item == std::end(deltas)) {
-          stack.push_back(binary->left());
-        } else if (rhs_item == std::end(deltas)) {
-          stack.push_back(binary->right());
-        } else {
-          stack.pop_back();
-          if (std::dynamic_pointer_cast<graph_add>(binary)) {
-            /* d/dx (f(x) + g(x)) = d/dx f(x) + d/dx g(x) */
-            deltas[top] += deltas[binary->left()] + deltas[binary->right()];
-          } else if (std::dynamic_pointer_cast<graph_sub>(binary)) {
-            /* d/dx (f(x) - g(x)) = d/dx f(x) - d/dx g(x) */
-            deltas[top] += deltas[binary->left()] - deltas[binary->right()];
-          } else if (std::dynamic_pointer_cast<graph_mul>(binary)) {
-            /* d/dx (f(x) * g(x)) = f(x)g'(x) + f'(x)g(x) */
-            deltas[top] += get_value(binary->left()) * deltas[binary->right()];
-            deltas[top] += deltas[binary->left()] * get_value(binary->right());
-          } else {
-            throw std::runtime_error("Node type not implemented");
-          }
+        if (commutative && known[lhs] && values_[lhs] == identity) {
+          slots_[h] = rhs;
+          continue;
         }
       }
+      if (commutative && lhs > rhs) {
+        std::swap(lhs, rhs);
+      }
+      const std::tuple<graph_opcode, uint32_t, uint32_t> key(node.op, lhs, rhs);
+      auto item = expressions.find(key);
+      if (item != std::end(expressions)) {
+        slots_[h] = item->second;
+        continue;
+      }
+      graph_instruction instruction;
+      instruction.op = node.op;
+      instruction.lhs = lhs;
+      instruction.rhs = rhs;
+      instruction.out = uint32_t(values_.size());
+      values_.push_back(0.0);
+      known.push_back(0);
+      pinned.push_back(0);
+      code_.push_back(instruction);
+      expressions.emplace(key, instruction.out);
+      slots_[h] = instruction.out;
+    }
+    for (const graph_handle root : roots) {
+      outputs_.push_back(slots_[root]);
     }
-    return deltas[graph.root()];
+    eliminate(pinned);
+    root_ = outputs_[0];
+    deltas_.resize(values_.size());
   }
-private:
-  double get_value(const std::shared_ptr<graph_node>& node) const {
-      auto map_item = values_.find(node);
-      if (map_item == std::end(values_)) {
-          return 0.0;
-      } else {
-          return map_item->second;
+  size_t num_outputs() const {
+    return outputs_.size();
+  }
+  /* Slot holding output index after evaluate() */
+  size_t output(const size_t index) const {
+    return outputs_[index];
+  }
+  bool empty() const {
+    return values_.empty();
+  }
+  size_t size() const {
+    return values_.size();
+  }
+  size_t slot(const graph_builder& node) const {
+    if (node.handle() >= slots_.size() || slots_[node.handle()] == unscheduled) {
+      throw std::runtime_error("Node is not part of the program");
+    }
+    return slots_[node.handle()];
+  }
+  T get_value(const size_t slot) const {
+    return values_[slot];
+  }
+  void set_value(const size_t slot, const T value) {
+    values_[slot] = value;
+  }
+  T get_parameter(const graph_builder& graph) const {
+    return values_[slot(graph)];
+  }
+  void set_parameter(const graph_builder& parameter, const T value) {
+    values_[slot(parameter)] = value;
+  }
+  T evaluate() {
+    T* v = values_.data();
+    for (const graph_instruction& instruction : code_) {
+      switch (instruction.op) {
+      case graph_opcode::add:
+        v[instruction.out] = v[instruction.lhs] + v[instruction.rhs];
+        break;
+      case graph_opcode::sub:
+        v[instruction.out] = v[instruction.lhs] - v[instruction.rhs];
+        break;
+      case graph_opcode::mul:
+        v[instruction.out] = v[instruction.lhs] * v[instruction.rhs];
+        break;
+      case graph_opcode::sqrt:
+        v[instruction.out] = std::sqrt(v[instruction.lhs]);
+        break;
+      case graph_opcode::tanh:
+        v[instruction.out] = std::tanh(v[instruction.lhs]);
+        break;
       }
+    }
+    return v[root_];
+  }
+  /* Evaluates the program and copies every output into results */
+  void evaluate(std::vector<T>& results) {
+    evaluate();
+    results.resize(outputs_.size());
+    for (size_t i = 0; i < outputs_.size(); ++i) {
+      results[i] = values_[outputs_[i]];
+    }
   }
-  std::map<std::shared_ptr<graph_node>, double> values_;
+  /* Forward-mode derivative of the root with respect to one slot, using the
+   * values from the last call to evaluate(). */
+  T evaluate_delta(const size_t parameter) {
+    const T* v = values_.data();
+    T* d = deltas_.data();
+    std::fill(std::begin(deltas_), std::end(deltas_), 0.0);
+    d[parameter] = 1; /* d/dx x = 1 */
+    for (const graph_instruction& instruction : code_) {
+      switch (instruction.op) {
+      case graph_opcode::add:
+        d[instruction.out] = d[instruction.lhs] + d[instruction.rhs];
+        break;
+      case graph_opcode::sub:
+        d[instruction.out] = d[instruction.lhs] - d[instruction.rhs];
+        break;
+      case graph_opcode::mul:
+        d[instruction.out] = v[instruction.lhs] * d[instruction.rhs] + d[instruction.lhs] * v[instruction.rhs];
+        break;
+      case graph_opcode::sqrt:
+        /* d/dx x^(1/2) = (1/2) x^(-1/2), reusing the forward value */
+        d[instruction.out] = d[instruction.lhs] / (2 * v[instruction.out]);
+        break;
+      case graph_opcode::tanh:
+        /* d/dx tanh(x) = 1 - tanh^2(x), reusing the forward value */
+        d[instruction.out] = (1 - v[instruction.out] * v[instruction.out]) * d[instruction.lhs];
+        break;
+      }
+    }
+    return d[root_];
+  }
+  /* Reverse-mode derivatives of the root with respect to every slot in
+   * parameters, using the values from the last call to evaluate(). One
+   * backward sweep over the tape serves all parameters at once. */
+  void gradient(const std::vector<size_t>& parameters, std::vector<T>& gradients) {
+    const T* v = values_.data();
+    T* d = deltas_.data();
+    std::fill(std::begin(deltas_), std::end(deltas_), 0.0);
+    d[root_] = 1; /* d/dy y = 1 */
+    for (auto it = code_.rbegin(); it != code_.rend(); ++it) {
+      const graph_instruction& instruction = *it;
+      const T adjoint = d[instruction.out];
+      switch (instruction.op) {
+      case graph_opcode::add:
+        d[instruction.lhs] += adjoint;
+        d[instruction.rhs] += adjoint;
+        break;
+      case graph_opcode::sub:
+        d[instruction.lhs] += adjoint;
+        d[instruction.rhs] -= adjoint;
+        break;
+      case graph_opcode::mul:
+        d[instruction.lhs] += adjoint * v[instruction.rhs];
+        d[instruction.rhs] += adjoint * v[instruction.lhs];
+        break;
+      case graph_opcode::sqrt:
+        d[instruction.lhs] += adjoint / (2 * v[instruction.out]);
+        break;
+      case graph_opcode::tanh:
+        d[instruction.lhs] += adjoint * (1 - v[instruction.out] * v[instruction.out]);
+        break;
+      }
+    }
+    gradients.resize(parameters.size());
+    for (size_t i = 0; i < parameters.size(); ++i) {
+      gradients[i] = d[parameters[i]];
+    }
+  }
+private:
+  static const uint32_t unscheduled = std::numeric_limits<uint32_t>::max();
+  /* Drops instructions and constants that no output depends on and packs
+   * the remaining slots together, keeping their order. */
+  void eliminate(const std::vector<uint8_t>& pinned) {
+    std::vector<uint8_t> live(pinned);
+    for (const uint32_t output : outputs_) {
+      live[output] = 1;
+    }
+    for (auto it = code_.rbegin(); it != code_.rend(); ++it) {
+      if (live[it->out]) {
+        live[it->lhs] = 1;
+        live[it->rhs] = 1;
+      }
+    }
+    std::vector<uint32_t> remap(values_.size(), uint32_t(unscheduled));
+    std::vector<T> values;
+    for (size_t slot = 0; slot < values_.size(); ++slot) {
+      if (live[slot]) {
+        remap[slot] = uint32_t(values.size());
+        values.push_back(values_[slot]);
+      }
+    }
+    std::vector<graph_instruction> code;
+    for (graph_instruction instruction : code_) {
+      if (live[instruction.out]) {
+        instruction.out = remap[instruction.out];
+        instruction.lhs = remap[instruction.lhs];
+        instruction.rhs = remap[instruction.rhs];
+        code.push_back(instruction);
+      }
+    }
+    for (uint32_t& slot : slots_) {
+      if (slot != unscheduled) {
+        slot = remap[slot];
+      }
+    }
+    for (uint32_t& output : outputs_) {
+      output = remap[output];
+    }
+    values_.swap(values);
+    code_.swap(code);
+  }
+  std::vector<uint32_t> slots_; /* slot of each arena node, by handle */
+  std::vector<graph_instruction> code_;
+  std::vector<T> values_;
+  std::vector<T> deltas_;
+  std::vector<uint32_t> outputs_;
+  uint32_t root_ = 0;
 };
 
+/* Derivatives of graph with respect to each of parameters in a single
+ * reverse-mode sweep. Compiles the graph on every call; hold on to a
+ * graph_program instead when differentiating the same graph repeatedly. */
+template <typename T>
+inline std::vector<T> basic_graph_evaluator<T>::gradient(const graph_builder& graph, const std::vector<graph_builder>& parameters) const {
+  basic_graph_program<T> program(*this, graph);
+  std::vector<size_t> slots(parameters.size());
+  for (size_t i = 0; i < parameters.size(); ++i) {
+    slots[i] = program.slot(parameters[i]);
+  }
+  program.evaluate();
+  std::vector<T> gradients;
+  program.gradient(slots, gradients);
+  return gradients;
+}
+
+typedef basic_graph_evaluator<double> graph_evaluator;
+typedef basic_graph_program<double> graph_program;
+typedef basic_graph_program<float> graph_program_float;
+
 class bp_layer {
 public:
-     bp_layer(graph_evaluator& bp, const std::vector<graph_builder>& inputs, const size_t num_outputs, const bool final_layer) {
+     template <typename T>
+     bp_layer(basic_graph_evaluator<T>& bp, const std::vector<graph_builder>& inputs, const size_t num_outputs, const bool final_layer) {
         const size_t num_weights = inputs.size() + 1; /* plus bias */
         std::vector<graph_builder> parameters(num_outputs * num_weights);
         for (size_t i = 0; i < parameters.size(); ++i) {
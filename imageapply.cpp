@@ -0,0 +1,104 @@
+#include "imageapply.h"
+#include "colourcache.h"
+#include <algorithm>
+#include <vector>
+
+QImage prepare_image(const QImage& image) {
+    QImage result = image;
+    if (result.format() != QImage::Format_RGB32 && result.format() != QImage::Format_ARGB32) {
+        result = result.convertToFormat(result.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+
+    /* Detach before any parallel region so the threads don't race on it */
+    result.scanLine(0);
+
+    return result;
+}
+
+void apply_direct(const pixel_transform& transform, QImage& image, const std::atomic<bool>& abort) {
+    const int width = image.width();
+    const int height = image.height();
+
+    #pragma omp parallel
+    {
+        std::vector<float> red(width);
+        std::vector<float> green(width);
+        std::vector<float> blue(width);
+        const float* const input[] = { red.data(), green.data(), blue.data() };
+        float* const output[] = { red.data(), green.data(), blue.data() };
+
+        #pragma omp for schedule(dynamic, 8)
+        for (int y = 0; y < height; ++y) {
+            if (abort == true) {
+                continue;
+            }
+
+            QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+            for (int x = 0; x < width; ++x) {
+                red[x] = qRed(line[x]) / 255.0f;
+                green[x] = qGreen(line[x]) / 255.0f;
+                blue[x] = qBlue(line[x]) / 255.0f;
+            }
+
+            transform.apply(input, output, width);
+
+            for (int x = 0; x < width; ++x) {
+                line[x] = qRgba(int(red[x] * 255 + 0.5f), int(green[x] * 255 + 0.5f), int(blue[x] * 255 + 0.5f), qAlpha(line[x]));
+            }
+        }
+    }
+}
+
+bool apply_cached(const pixel_transform& transform, QImage& image, const std::atomic<bool>& abort) {
+    const int width = image.width();
+    const int height = image.height();
+
+    /* Give up once there are too many distinct colours for the lookups to
+     * be cheaper than evaluating every pixel. */
+    const double max_unique_ratio = 0.25;
+    const size_t pixels = size_t(width) * size_t(height);
+    const size_t max_colours = std::max<size_t>(1, std::min<size_t>(size_t(double(pixels) * max_unique_ratio), size_t(1) << 24));
+
+    /* The full scan below is serial, so first count the colours of a
+     * strided sample. A sample has at least the unique ratio of the whole
+     * image, so a photo with many colours is turned away after a few
+     * thousand pixels rather than a quarter of them. */
+    const size_t max_samples = 1 << 16;
+    if (pixels > max_samples) {
+        const size_t stride = pixels / max_samples;
+        colour_cache sample(size_t(max_samples * max_unique_ratio));
+        for (size_t i = 0; i < max_samples; ++i) {
+            const size_t index = i * stride;
+            const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(int(index / size_t(width))));
+            if (!sample.insert(line[index % size_t(width)] & 0xffffff)) {
+                return false;
+            }
+        }
+    }
+
+    colour_cache cache(max_colours);
+    for (int y = 0; y < height; ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        for (int x = 0; x < width; ++x) {
+            if (!cache.insert(line[x] & 0xffffff)) {
+                return false;
+            }
+        }
+    }
+
+    cache.evaluate(transform);
+
+    #pragma omp parallel for schedule(dynamic, 8)
+    for (int y = 0; y < height; ++y) {
+        if (abort == true) {
+            continue;
+        }
+
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < width; ++x) {
+            line[x] = (line[x] & 0xff000000) | cache.lookup(line[x] & 0xffffff);
+        }
+    }
+
+    return true;
+}
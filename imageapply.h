@@ -0,0 +1,24 @@
+#ifndef __IMAGE_APPLY_H__
+#define __IMAGE_APPLY_H__
+
+#include "pixeltransform.h"
+#include <atomic>
+#include <QImage>
+
+/* Copy of image in Format_RGB32 or Format_ARGB32, whichever keeps its
+ * alpha, detached and ready for the apply functions below. */
+QImage prepare_image(const QImage& image);
+
+/* Maps every pixel of image through transform in place, with the rows
+ * spread across threads. Alpha is carried through unchanged. Rows not yet
+ * started are skipped once abort is set. image must come from
+ * prepare_image(). */
+void apply_direct(const pixel_transform& transform, QImage& image, const std::atomic<bool>& abort);
+
+/* As apply_direct(), but evaluates transform once per distinct colour.
+ * Returns false without touching image when it has too many colours for
+ * that to pay off, judged from a sample first so that finding out is
+ * cheap. */
+bool apply_cached(const pixel_transform& transform, QImage& image, const std::atomic<bool>& abort);
+
+#endif /* __IMAGE_APPLY_H__ */
@@ -0,0 +1,59 @@
+#include "imageloader.h"
+#include "imageapply.h"
+#include <QImageReader>
+#include <algorithm>
+#include <functional>
+
+image_loader::image_loader(const std::string& file_name, const int placeholder_size) : file_name_(file_name), placeholder_size_(placeholder_size), has_placeholder_(false) {
+    stage_ = reading_header;
+    thread_ = std::make_shared<std::thread>(std::bind(&image_loader::thread_function, this));
+}
+
+image_loader::~image_loader() {
+    thread_->join();
+}
+
+bool image_loader::take_placeholder(QImage& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_placeholder_) {
+        return false;
+    }
+    image = placeholder_;
+    placeholder_ = QImage();
+    has_placeholder_ = false;
+    return true;
+}
+
+void image_loader::thread_function() {
+    const QString file_name = QString::fromStdString(file_name_);
+
+    {
+        /* A reader decodes once, so the placeholder uses one of its own */
+        QImageReader reader(file_name);
+        const QSize size = reader.size();
+        if (size.isValid() && std::max(size.width(), size.height()) > placeholder_size_ && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+            stage_ = decoding_placeholder;
+            reader.setScaledSize(size.scaled(placeholder_size_, placeholder_size_, Qt::KeepAspectRatio));
+            const QImage placeholder = reader.read();
+            if (!placeholder.isNull()) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                placeholder_ = placeholder;
+                has_placeholder_ = true;
+            }
+        }
+    }
+
+    stage_ = decoding;
+    QImageReader reader(file_name);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        error_ = reader.errorString().toStdString();
+        stage_ = finished;
+        return;
+    }
+
+    stage_ = building_pyramid;
+    image_ = prepare_image(image);
+    pyramid_ = image_pyramid(image_);
+    stage_ = finished;
+}
@@ -0,0 +1,74 @@
+#ifndef __IMAGE_LOADER_H__
+#define __IMAGE_LOADER_H__
+
+#include "imagepyramid.h"
+#include <QImage>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/* Decodes an image file on a background thread.
+ *
+ * When the format's plugin can decode straight to a smaller size (JPEG
+ * can), a placeholder no larger than placeholder_size is read first so
+ * there is something to show almost at once. The full image is then
+ * decoded, converted for prepare_image() and halved into an
+ * image_pyramid, all off the calling thread. */
+class image_loader {
+public:
+    enum stage {
+        reading_header,
+        decoding_placeholder,
+        decoding,
+        building_pyramid,
+        finished
+    };
+
+    image_loader(const std::string& file_name, const int placeholder_size);
+
+    /* Waits for a decode in progress to finish */
+    ~image_loader();
+
+    stage get_stage() const {
+        return stage_;
+    }
+
+    bool is_done() const {
+        return stage_ == finished;
+    }
+
+    /* Moves the placeholder into image; returns false if none is ready */
+    bool take_placeholder(QImage& image);
+
+    /* The decoded image and its pyramid, or a null image and the reason
+     * it could not be read; valid once done */
+    const QImage& image() const {
+        return image_;
+    }
+
+    const image_pyramid& pyramid() const {
+        return pyramid_;
+    }
+
+    std::string error() const {
+        return error_;
+    }
+
+private:
+    void thread_function();
+
+    std::string file_name_;
+    int placeholder_size_;
+    std::mutex mutex_;
+    QImage placeholder_;
+    bool has_placeholder_;
+    QImage image_;
+    image_pyramid pyramid_;
+    std::string error_;
+    std::atomic<stage> stage_;
+    std::shared_ptr<std::thread> thread_;
+};
+
+#endif /* __IMAGE_LOADER_H__ */
@@ -0,0 +1,26 @@
+#include "imagepyramid.h"
+#include <algorithm>
+
+image_pyramid::image_pyramid() {
+}
+
+image_pyramid::image_pyramid(const QImage& image, const int min_size) {
+    if (image.isNull()) {
+        return;
+    }
+    levels_.push_back(image);
+    while (std::max(levels_.back().width(), levels_.back().height()) > min_size) {
+        const QImage& previous = levels_.back();
+        const int width = std::max(1, previous.width() / 2);
+        const int height = std::max(1, previous.height() / 2);
+        levels_.push_back(previous.scaled(width, height, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+}
+
+const QImage& image_pyramid::level_for(const int max_size) const {
+    size_t index = 0;
+    while (index + 1 < levels_.size() && std::max(levels_[index + 1].width(), levels_[index + 1].height()) >= max_size) {
+        index++;
+    }
+    return levels_[index];
+}
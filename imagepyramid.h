@@ -0,0 +1,35 @@
+#ifndef __IMAGE_PYRAMID_H__
+#define __IMAGE_PYRAMID_H__
+
+#include <QImage>
+#include <vector>
+
+/* Successively halved copies of an image, level 0 being the original.
+ * Halving stops once the longest side is at most min_size pixels. */
+class image_pyramid {
+public:
+    image_pyramid();
+
+    explicit image_pyramid(const QImage& image, const int min_size = 64);
+
+    bool empty() const {
+        return levels_.empty();
+    }
+
+    size_t num_levels() const {
+        return levels_.size();
+    }
+
+    const QImage& level(const size_t index) const {
+        return levels_[index];
+    }
+
+    /* The smallest level whose longest side is still at least max_size
+     * pixels, or the original if it is smaller than that already. */
+    const QImage& level_for(const int max_size) const;
+
+private:
+    std::vector<QImage> levels_;
+};
+
+#endif /* __IMAGE_PYRAMID_H__ */
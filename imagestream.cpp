@@ -0,0 +1,162 @@
+#include "imagestream.h"
+#include "imageapply.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+/* Next header token of a PNM file, skipping whitespace and comments */
+std::string pnm_token(std::istream& in) {
+    std::string token;
+    char c;
+    while (in.get(c)) {
+        if (c == '#') {
+            std::string comment;
+            std::getline(in, comment);
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (!token.empty()) {
+                break;
+            }
+        } else {
+            token += c;
+        }
+    }
+    return token;
+}
+
+/* Next header token as a non-negative number, or -1 if it is not one */
+long pnm_number(std::istream& in) {
+    const std::string token = pnm_token(in);
+    if (token.empty() || token.size() > 9 || token.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    return std::stol(token);
+}
+
+/* Largest strip of file data read at once; the RGB32 strip built from it
+ * is a third larger */
+const uint64_t max_strip_bytes = uint64_t(1) << 30;
+
+bool ends_with(const std::string& text, const std::string& suffix) {
+    if (text.size() < suffix.size()) {
+        return false;
+    }
+    std::string tail = text.substr(text.size() - suffix.size());
+    std::transform(std::begin(tail), std::end(tail), std::begin(tail), ::tolower);
+    return tail == suffix;
+}
+
+}
+
+ppm_strip_reader::ppm_strip_reader(const std::string& file_name) : file_(file_name, std::ios::binary) {
+    if (!file_) {
+        throw std::runtime_error("Cannot open " + file_name);
+    }
+    if (pnm_token(file_) != "P6") {
+        throw std::runtime_error(file_name + " is not a binary PPM");
+    }
+    const long width = pnm_number(file_);
+    const long height = pnm_number(file_);
+    if (width <= 0 || height <= 0) {
+        throw std::runtime_error(file_name + " has a bad PPM size");
+    }
+    if (uint64_t(width) * 3 > max_strip_bytes) {
+        throw std::runtime_error(file_name + " is too wide to stream");
+    }
+    const long maxval = pnm_number(file_);
+    if (maxval < 1 || maxval > 255) {
+        throw std::runtime_error(file_name + " is not an 8-bit PPM");
+    }
+    width_ = int(width);
+    height_ = int(height);
+    maxval_ = int(maxval);
+    data_offset_ = file_.tellg();
+
+    /* Catch a size the data cannot back before anything is allocated */
+    file_.seekg(0, std::ios::end);
+    if (data_offset_ < 0 || uint64_t(file_.tellg() - data_offset_) < uint64_t(width_) * uint64_t(height_) * 3) {
+        throw std::runtime_error(file_name + " is truncated");
+    }
+}
+
+QImage ppm_strip_reader::read(const int y, const int rows) {
+    if (y < 0 || rows <= 0 || rows > height_ - y || uint64_t(width_) * 3 * uint64_t(rows) > max_strip_bytes) {
+        throw std::runtime_error("PPM strip is out of range or too large");
+    }
+    QImage strip(width_, rows, QImage::Format_RGB32);
+    std::vector<char> buffer(size_t(width_) * 3);
+    file_.seekg(data_offset_ + std::streamoff(y) * width_ * 3);
+    for (int row = 0; row < rows; ++row) {
+        if (!file_.read(buffer.data(), std::streamsize(buffer.size()))) {
+            throw std::runtime_error("Unexpected end of PPM data");
+        }
+        QRgb* line = reinterpret_cast<QRgb*>(strip.scanLine(row));
+        const unsigned char* rgb = reinterpret_cast<const unsigned char*>(buffer.data());
+        if (maxval_ == 255) {
+            for (int x = 0; x < width_; ++x) {
+                line[x] = qRgb(rgb[x * 3], rgb[x * 3 + 1], rgb[x * 3 + 2]);
+            }
+        } else {
+            auto level = [&](const int value) {
+                return std::min(value, maxval_) * 255 / maxval_;
+            };
+            for (int x = 0; x < width_; ++x) {
+                line[x] = qRgb(level(rgb[x * 3]), level(rgb[x * 3 + 1]), level(rgb[x * 3 + 2]));
+            }
+        }
+    }
+    return strip;
+}
+
+std::unique_ptr<strip_reader> open_strip_reader(const std::string& file_name) {
+    if (!ends_with(file_name, ".ppm")) {
+        throw std::runtime_error(file_name + " cannot be streamed; convert it to PPM");
+    }
+    return std::unique_ptr<strip_reader>(new ppm_strip_reader(file_name));
+}
+
+ppm_strip_writer::ppm_strip_writer(const std::string& file_name, const int width, const int height) : file_(file_name, std::ios::binary), width_(width), height_(height), rows_written_(0) {
+    if (!file_) {
+        throw std::runtime_error("Cannot create " + file_name);
+    }
+    file_ << "P6\n" << width_ << " " << height_ << "\n255\n";
+}
+
+void ppm_strip_writer::write(const QImage& strip) {
+    std::vector<char> buffer(size_t(width_) * 3);
+    for (int row = 0; row < strip.height(); ++row) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(strip.constScanLine(row));
+        for (int x = 0; x < width_; ++x) {
+            buffer[x * 3] = char(qRed(line[x]));
+            buffer[x * 3 + 1] = char(qGreen(line[x]));
+            buffer[x * 3 + 2] = char(qBlue(line[x]));
+        }
+        file_.write(buffer.data(), std::streamsize(buffer.size()));
+    }
+    rows_written_ += strip.height();
+}
+
+void ppm_strip_writer::close() {
+    file_.close();
+    if (!file_ || rows_written_ != height_) {
+        throw std::runtime_error("Failed to write the output image");
+    }
+}
+
+double stream_apply(const pixel_transform& transform, const std::string& file_name, const std::string& output_file, const int strip_rows, const std::atomic<bool>& abort) {
+    std::unique_ptr<strip_reader> reader = open_strip_reader(file_name);
+    ppm_strip_writer writer(output_file, reader->width(), reader->height());
+
+    for (int y = 0; y < reader->height() && abort == false; y += strip_rows) {
+        const int rows = std::min(strip_rows, reader->height() - y);
+        QImage strip = reader->read(y, rows);
+        apply_direct(transform, strip, abort);
+        writer.write(strip);
+    }
+
+    writer.close();
+    return double(reader->width()) * double(reader->height());
+}
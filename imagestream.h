@@ -0,0 +1,72 @@
+#ifndef __IMAGE_STREAM_H__
+#define __IMAGE_STREAM_H__
+
+#include "pixeltransform.h"
+#include <QImage>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+
+/* Source of an image one horizontal strip at a time, so that only the
+ * strip being processed has to be held in memory. */
+class strip_reader {
+public:
+    virtual ~strip_reader() = default;
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    /* Rows [y, y + rows) in Format_RGB32 or Format_ARGB32 */
+    virtual QImage read(const int y, const int rows) = 0;
+};
+
+/* Reads binary PPM (P6, maxval up to 255) rows straight from the file.
+ * The constructor throws std::runtime_error for a header with a
+ * non-positive size or maxval, or one the file is too short to hold. */
+class ppm_strip_reader : public strip_reader {
+public:
+    explicit ppm_strip_reader(const std::string& file_name);
+    int width() const override {
+        return width_;
+    }
+    int height() const override {
+        return height_;
+    }
+    QImage read(const int y, const int rows) override;
+private:
+    std::ifstream file_;
+    std::streamoff data_offset_;
+    int width_;
+    int height_;
+    int maxval_;
+};
+
+/* Opens file_name with the reader suited to its format. Throws
+ * std::runtime_error if it cannot be streamed.
+ *
+ * Only PPM is accepted. QImageReader has no way to resume decoding where
+ * the last strip ended, so reading each strip through a clip rectangle
+ * decodes everything above it again and the whole image costs O(height^2). */
+std::unique_ptr<strip_reader> open_strip_reader(const std::string& file_name);
+
+/* Writes a binary PPM (P6) incrementally, top to bottom. Alpha is
+ * dropped, as PPM has no alpha channel. */
+class ppm_strip_writer {
+public:
+    ppm_strip_writer(const std::string& file_name, const int width, const int height);
+    void write(const QImage& strip);
+    /* Throws std::runtime_error if any write failed */
+    void close();
+private:
+    std::ofstream file_;
+    int width_;
+    int height_;
+    int rows_written_;
+};
+
+/* Streams the image in file_name through transform into a PPM at
+ * output_file, strip_rows rows at a time. Peak memory depends on
+ * strip_rows and the image width, not on its height. Returns the number of
+ * pixels processed. */
+double stream_apply(const pixel_transform& transform, const std::string& file_name, const std::string& output_file, const int strip_rows, const std::atomic<bool>& abort);
+
+#endif /* __IMAGE_STREAM_H__ */
@@ -0,0 +1,229 @@
+#include "imageview.h"
+#include <QApplication>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QWheelEvent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/* Side of a square tile in pyramid level pixels */
+const int tileSize = 256;
+
+/* How close to the divider a press has to be to grab it */
+const int splitGrab = 4;
+
+const double minScale = 1.0 / 256;
+const double maxScale = 64;
+
+quint64 tileKey(const int index, const size_t level, const int tx, const int ty) {
+    return (quint64(index) << 63) | (quint64(level) << 56) | (quint64(ty) << 28) | quint64(tx);
+}
+
+}
+
+ImageView::ImageView(QWidget *parent) :
+    QWidget(parent),
+    scale_(1),
+    split_(0.5),
+    fitted_(true),
+    drag_(NoDrag),
+    moved_(false)
+{
+    setMouseTracking(true);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+void ImageView::setImage(const QImage& image) {
+    setPyramid(image_pyramid(image));
+}
+
+void ImageView::setPyramid(const image_pyramid& pyramid) {
+    const QSize previous = imageSize();
+    pyramids_[0] = pyramid;
+    tiles_.clear();
+    if (fitted_ || imageSize() != previous) {
+        fit();
+    }
+    update();
+}
+
+void ImageView::setComparison(const QImage& image) {
+    setComparison(image_pyramid(image));
+}
+
+void ImageView::setComparison(const image_pyramid& pyramid) {
+    pyramids_[1] = pyramid;
+    tiles_.clear();
+    update();
+}
+
+void ImageView::clear() {
+    pyramids_[0] = image_pyramid();
+    pyramids_[1] = image_pyramid();
+    tiles_.clear();
+    update();
+}
+
+void ImageView::fit() {
+    const QSize size = imageSize();
+    fitted_ = true;
+    if (size.isEmpty() || width() <= 0 || height() <= 0) {
+        return;
+    }
+    /* Small images are shown at their own size rather than enlarged */
+    scale_ = std::min(1.0, std::min(double(width()) / size.width(), double(height()) / size.height()));
+    origin_ = QPointF(size.width() / 2.0 - width() / (2 * scale_), size.height() / 2.0 - height() / (2 * scale_));
+    update();
+}
+
+QSize ImageView::imageSize() const {
+    return pyramids_[0].empty() ? QSize() : pyramids_[0].level(0).size();
+}
+
+size_t ImageView::levelFor(const image_pyramid& pyramid) const {
+    const double reference = imageSize().width();
+    size_t index = 0;
+    while (index + 1 < pyramid.num_levels() && pyramid.level(index + 1).width() / reference >= scale_) {
+        index++;
+    }
+    return index;
+}
+
+int ImageView::splitX() const {
+    return int(std::lround(split_ * width()));
+}
+
+void ImageView::drawPyramid(QPainter& painter, const image_pyramid& pyramid, const int index, const QRect& area) {
+    if (pyramid.empty() || area.isEmpty()) {
+        return;
+    }
+
+    /* Positions are in the coordinates of the first image, so a comparison
+     * of another size is stretched over it */
+    const size_t level = levelFor(pyramid);
+    const QImage& image = pyramid.level(level);
+    const QSize reference = imageSize();
+    const double fx = double(image.width()) / reference.width();
+    const double fy = double(image.height()) / reference.height();
+
+    const int left = std::max(0, int(std::floor((origin_.x() + area.left() / scale_) * fx)));
+    const int top = std::max(0, int(std::floor((origin_.y() + area.top() / scale_) * fy)));
+    const int right = std::min(image.width(), int(std::ceil((origin_.x() + (area.right() + 1) / scale_) * fx)));
+    const int bottom = std::min(image.height(), int(std::ceil((origin_.y() + (area.bottom() + 1) / scale_) * fy)));
+    if (left >= right || top >= bottom) {
+        return;
+    }
+
+    painter.save();
+    painter.setClipRect(area);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, scale_ < fx);
+
+    for (int ty = top / tileSize; ty <= (bottom - 1) / tileSize; ++ty) {
+        for (int tx = left / tileSize; tx <= (right - 1) / tileSize; ++tx) {
+            const QRect source = QRect(tx * tileSize, ty * tileSize, tileSize, tileSize) & image.rect();
+            const quint64 key = tileKey(index, level, tx, ty);
+            QPixmap* tile = tiles_.object(key);
+            if (!tile) {
+                tiles_.insert(key, new QPixmap(QPixmap::fromImage(image.copy(source))), std::max(1, source.width() * source.height() * 4 / 1024));
+                tile = tiles_.object(key);
+                if (!tile) {
+                    continue;
+                }
+            }
+            const QRectF target((source.x() / fx - origin_.x()) * scale_, (source.y() / fy - origin_.y()) * scale_, source.width() / fx * scale_, source.height() / fy * scale_);
+            painter.drawPixmap(target, *tile, QRectF(tile->rect()));
+        }
+    }
+
+    painter.restore();
+}
+
+void ImageView::paintEvent(QPaintEvent *) {
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().dark());
+
+    if (pyramids_[1].empty()) {
+        drawPyramid(painter, pyramids_[0], 0, rect());
+        return;
+    }
+
+    const int x = splitX();
+    drawPyramid(painter, pyramids_[0], 0, QRect(0, 0, x, height()));
+    drawPyramid(painter, pyramids_[1], 1, QRect(x, 0, width() - x, height()));
+    painter.setPen(QPen(palette().highlight(), 2));
+    painter.drawLine(x, 0, x, height());
+}
+
+void ImageView::resizeEvent(QResizeEvent *) {
+    /* Enough for every tile on screen in both images, at up to twice the
+     * screen resolution, plus a border of tiles for panning */
+    const qint64 pixels = qint64(2 * width() + 2 * tileSize) * (2 * height() + 2 * tileSize);
+    tiles_.setMaxCost(int(std::min<qint64>(3 * pixels * 4 / 1024, 1 << 30)));
+    if (fitted_) {
+        fit();
+    }
+}
+
+void ImageView::mousePressEvent(QMouseEvent *event) {
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+    pressPos_ = event->pos();
+    lastPos_ = event->pos();
+    moved_ = false;
+    drag_ = (!pyramids_[1].empty() && std::abs(event->pos().x() - splitX()) <= splitGrab) ? SplitDrag : PanDrag;
+}
+
+void ImageView::mouseMoveEvent(QMouseEvent *event) {
+    if (drag_ == NoDrag) {
+        const bool overSplit = !pyramids_[1].empty() && std::abs(event->pos().x() - splitX()) <= splitGrab;
+        setCursor(overSplit ? Qt::SplitHCursor : Qt::ArrowCursor);
+        return;
+    }
+
+    if (drag_ == SplitDrag) {
+        split_ = std::min(1.0, std::max(0.0, double(event->pos().x()) / std::max(1, width())));
+        update();
+        return;
+    }
+
+    /* Small movements during a click do not pan */
+    if (!moved_ && (event->pos() - pressPos_).manhattanLength() < QApplication::startDragDistance()) {
+        return;
+    }
+    moved_ = true;
+    fitted_ = false;
+    origin_ -= QPointF(event->pos() - lastPos_) / scale_;
+    lastPos_ = event->pos();
+    update();
+}
+
+void ImageView::mouseReleaseEvent(QMouseEvent *event) {
+    if (event->button() == Qt::MiddleButton) {
+        fit();
+        return;
+    }
+    if (event->button() != Qt::LeftButton) {
+        return;
+    }
+    if (drag_ == PanDrag && !moved_ && !pyramids_[0].empty()) {
+        const QPoint position(int(std::floor(origin_.x() + event->pos().x() / scale_)), int(std::floor(origin_.y() + event->pos().y() / scale_)));
+        if (QRect(QPoint(0, 0), imageSize()).contains(position)) {
+            emit clicked(position);
+        }
+    }
+    drag_ = NoDrag;
+}
+
+void ImageView::wheelEvent(QWheelEvent *event) {
+    const double steps = event->angleDelta().y() / 120.0;
+    const double scale = std::min(maxScale, std::max(minScale, scale_ * std::pow(1.25, steps)));
+    const QPointF cursor = event->position();
+    /* Keep the image point under the cursor where it is */
+    origin_ += cursor / scale_ - cursor / scale;
+    scale_ = scale;
+    fitted_ = false;
+    update();
+}
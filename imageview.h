@@ -0,0 +1,78 @@
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include "imagepyramid.h"
+#include <QWidget>
+#include <QPixmap>
+#include <QCache>
+
+/* Pan and zoom view of an image held as an image_pyramid.
+ *
+ * Each repaint picks the coarsest pyramid level that still has at least
+ * one pixel per screen pixel and draws only the tiles of it that are on
+ * screen. Tiles are converted to pixmaps when first shown and kept in a
+ * cache of bounded size, so memory and repaint time follow the size of
+ * the viewport rather than of the image.
+ *
+ * With a second image set by setComparison(), the view is split: the
+ * first image is shown left of a draggable divider and the second to its
+ * right, both at the same position and zoom.
+ *
+ * Dragging pans, the wheel zooms about the cursor and a middle click
+ * fits the image to the view. A click that does not drag is reported
+ * through clicked() in image coordinates. */
+class ImageView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ImageView(QWidget *parent = nullptr);
+
+    void setImage(const QImage& image);
+    void setPyramid(const image_pyramid& pyramid);
+
+    /* The image shown right of the divider; a null image removes it */
+    void setComparison(const QImage& image);
+    void setComparison(const image_pyramid& pyramid);
+
+    void clear();
+
+    /* Scales and centres the image to fill the view */
+    void fit();
+
+signals:
+    void clicked(const QPoint& imagePos);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private:
+    enum Drag {
+        NoDrag,
+        PanDrag,
+        SplitDrag
+    };
+
+    QSize imageSize() const;
+    size_t levelFor(const image_pyramid& pyramid) const;
+    void drawPyramid(QPainter& painter, const image_pyramid& pyramid, const int index, const QRect& area);
+    int splitX() const;
+
+    image_pyramid pyramids_[2];
+    QCache<quint64, QPixmap> tiles_;
+    double scale_; /* screen pixels per image pixel */
+    QPointF origin_; /* image position at the top left of the view */
+    double split_; /* divider position as a fraction of the width */
+    bool fitted_;
+    Drag drag_;
+    QPoint pressPos_;
+    QPoint lastPos_;
+    bool moved_;
+};
+
+#endif // IMAGEVIEW_H
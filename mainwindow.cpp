@@ -2,13 +2,27 @@
 #include "ui_mainwindow.h"
 #include "outputwindow.h"
 #include <QFileDialog>
-#include <QMouseEvent>
 #include <QColorDialog>
+#include <QStatusBar>
+#include <QProgressBar>
 #include <iostream>
 
+namespace {
+
+/* Longest side of the proxy image rendered while training */
+const int previewSize = 320;
+
+/* Longest side of the image shown while the full one is decoding */
+const int placeholderSize = 1024;
+
+}
+
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , loadProgress_(nullptr)
+    , loadTimer_(nullptr)
+    , previewVersion_(0)
 {
     ui->setupUi(this);
 
@@ -20,18 +34,30 @@ MainWindow::MainWindow(QWidget *parent)
     colourPanel_ = new ColourPanel(this);
     addDockWidget(Qt::LeftDockWidgetArea, colourPanel_);
 
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Open Image"), "/home/jana", tr("Image Files (*.png *.jpg *.bmp)"));
-
-    image_.load(fileName);
-
-    ui->label->setStyleSheet("QLabel { background-color : white; }");
+    previewPanel_ = new PreviewPanel(this);
+    addDockWidget(Qt::LeftDockWidgetArea, previewPanel_);
 
-    ui->label->setPixmap(QPixmap::fromImage(image_));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open Image"), "/home/jana", tr("Image Files (*.png *.jpg *.bmp)"));
 
-    ui->label->installEventFilter(this);
+    connect(ui->view, &ImageView::clicked, this, &MainWindow::imageClicked);
 
     timer_ = new QTimer(this);
     connect(timer_, &QTimer::timeout, this, &MainWindow::timerPoll);
+
+    /* Decoding a large image can take seconds, so it happens on a worker
+     * and nothing that needs the image is enabled until it is done */
+    if (!fileName.isEmpty()) {
+        runPanel_->setEnabled(false);
+        loadProgress_ = new QProgressBar(this);
+        loadProgress_->setRange(0, 0);
+        loadProgress_->setMaximumWidth(160);
+        statusBar()->addPermanentWidget(loadProgress_);
+        statusBar()->showMessage(tr("Loading %1").arg(fileName));
+        loader_ = std::make_shared<image_loader>(fileName.toStdString(), placeholderSize);
+        loadTimer_ = new QTimer(this);
+        connect(loadTimer_, &QTimer::timeout, this, &MainWindow::loadPoll);
+        loadTimer_->start(50);
+    }
 }
 
 MainWindow::~MainWindow()
@@ -39,30 +65,65 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
-bool MainWindow::eventFilter(QObject *o, QEvent *e) {
-    if (thread_) {
-        return false; /* still running */
+void MainWindow::imageClicked(const QPoint& pos) {
+    if (thread_ || loader_) {
+        return; /* still running or loading */
     }
-    if(o == ui->label && e->type() == QMouseEvent::MouseButtonPress) {
-        QMouseEvent* me = dynamic_cast<QMouseEvent*>(e);
-        src_colour_ = image_.pixel(me->pos());
-        QColorDialog* cd = new QColorDialog(src_colour_, this);
-        connect(cd, &QColorDialog::colorSelected, this, &MainWindow::colorSelected);
-        cd->show();
-    }
-    return false;
+    src_colour_ = image_.pixel(pos);
+    QColorDialog* cd = new QColorDialog(src_colour_, this);
+    connect(cd, &QColorDialog::colorSelected, this, &MainWindow::colorSelected);
+    cd->show();
 }
 
 void MainWindow::colorSelected(const QColor &color) {
     colourPanel_->addColourMapping(src_colour_, color);
 }
 
-void MainWindow::runBegin(const double learningRate) {
+void MainWindow::loadPoll() {
+    QImage placeholder;
+    if (loader_->take_placeholder(placeholder)) {
+        ui->view->setImage(placeholder);
+    }
+    if (!loader_->is_done()) {
+        if (loader_->get_stage() == image_loader::building_pyramid) {
+            statusBar()->showMessage(tr("Preparing image"));
+        }
+        return;
+    }
+
+    loadTimer_->stop();
+    statusBar()->removeWidget(loadProgress_);
+    loadProgress_->deleteLater();
+    loadProgress_ = nullptr;
+
+    if (loader_->image().isNull()) {
+        ui->view->clear();
+        statusBar()->showMessage(tr("Cannot load image: %1").arg(QString::fromStdString(loader_->error())));
+    } else {
+        image_ = loader_->image();
+        pyramid_ = loader_->pyramid();
+        ui->view->setPyramid(pyramid_);
+        statusBar()->showMessage(tr("Loaded %1 x %2").arg(image_.width()).arg(image_.height()), 5000);
+    }
+    loader_.reset();
+    runPanel_->setEnabled(true);
+}
+
+void MainWindow::runBegin(const run_settings& settings) {
     colourPanel_->setInputEnabled(false);
     runPanel_->setState(RunPanel::StopEnabled);
     runPanel_->resetGraph();
-    thread_ = std::make_shared<run_thread>(image_, colourPanel_->getColours(), learningRate);
-    timer_->start(500);
+    /* The output window shows the result through a pyramid, which is
+     * built with the rest of the run rather than on this thread */
+    run_settings run = settings;
+    run.result_pyramid = true;
+    thread_ = std::make_shared<run_thread>(image_, colourPanel_->getColours(), run, lastState_);
+    previewPanel_->clear();
+    if (!pyramid_.empty()) {
+        preview_ = std::make_shared<preview_worker>(pyramid_.level_for(previewSize));
+    }
+    previewVersion_ = 0;
+    timer_->start(250);
 }
 
 void MainWindow::runEnd() {
@@ -72,14 +133,29 @@ void MainWindow::runEnd() {
 
 void MainWindow::timerPoll() {
     if (thread_) {
+        std::vector<training_sample> samples;
+        thread_->take_telemetry(samples);
+        runPanel_->addSamples(samples);
         if (thread_->is_done()) {
-            OutputWindow* output = new OutputWindow(QPixmap::fromImage(thread_->result()), thread_->result_string(), this);
+            OutputWindow* output = new OutputWindow(pyramid_, thread_->result_pyramid(), thread_->result_string(), thread_->result_cube(), thread_->result_model(), this);
             output->show();
+            statusBar()->showMessage(tr("Training ended (%1%2), applied at %3 Mpixel/s").arg(QString::fromStdString(thread_->get_stop_reason())).arg(thread_->is_warm_started() ? tr(", continued from last run") : QString()).arg(thread_->get_pixels_per_second() / 1e6, 0, 'f', 1));
+            lastState_ = thread_->result_state();
             thread_.reset();
+            preview_.reset();
             runPanel_->setState(RunPanel::RunEnabled);
             colourPanel_->setInputEnabled(true);
-        } else if (thread_->is_running()){
-            runPanel_->setError(thread_->get_last_error(), thread_->get_best_error());
+        }
+        if (preview_) {
+            QImage preview;
+            if (preview_->take_result(preview)) {
+                previewPanel_->setPreview(preview);
+            }
+            const size_t version = thread_->get_best_version();
+            if (version != previewVersion_) {
+                preview_->submit(thread_->widths(), thread_->get_best_parameters());
+                previewVersion_ = version;
+            }
         }
     }
 }
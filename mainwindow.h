@@ -3,9 +3,14 @@
 
 #include "colourpanel.h"
 #include "runpanel.h"
+#include "previewpanel.h"
 #include "runthread.h"
+#include "imagepyramid.h"
+#include "previewworker.h"
+#include "imageloader.h"
 #include <QMainWindow>
 #include <QTimer>
+#include <QProgressBar>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -19,24 +24,34 @@ public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
-    bool eventFilter(QObject *o, QEvent *e) override;
+    void imageClicked(const QPoint& pos);
 
     void colorSelected(const QColor &color);
 
     void runClick();
 
-    void runBegin(const double learningRate);
+    void runBegin(const run_settings& settings);
     void runEnd();
 
     void timerPoll();
 
+    void loadPoll();
+
 private:
     Ui::MainWindow *ui;
     ColourPanel* colourPanel_;
     RunPanel* runPanel_;
+    PreviewPanel* previewPanel_;
     QImage image_;
+    image_pyramid pyramid_;
     QColor src_colour_;
     QTimer* timer_;
     std::shared_ptr<run_thread> thread_;
+    std::shared_ptr<const training_state> lastState_;
+    std::shared_ptr<preview_worker> preview_;
+    std::shared_ptr<image_loader> loader_;
+    QProgressBar* loadProgress_;
+    QTimer* loadTimer_;
+    size_t previewVersion_;
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,164 @@
+#include "mappingfile.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+std::runtime_error parse_error(const std::string& file_name, const size_t line_number, const std::string& message) {
+    std::stringstream ss;
+    ss << file_name << ":" << line_number << ": " << message;
+    return std::runtime_error(ss.str());
+}
+
+}
+
+void load_mapping_file(const std::string& file_name, std::vector<std::pair<QColor, QColor>>& cmap, run_settings& settings) {
+    std::ifstream file(file_name);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + file_name);
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+
+        std::stringstream ss(line);
+        std::string key;
+        if (!(ss >> key) || (key[0] == '#' && key.size() == 1) || key.compare(0, 2, "//") == 0) {
+            continue; /* blank or comment */
+        }
+
+        if (key == "rate") {
+            if (!(ss >> settings.learning_rate) || settings.learning_rate <= 0) {
+                throw parse_error(file_name, line_number, "expected a positive learning rate");
+            }
+        } else if (key == "layers") {
+            std::string rest;
+            std::getline(ss, rest);
+            std::stringstream widths(rest);
+            std::string item;
+            settings.hidden_layers.clear();
+            while (std::getline(widths, item, ',')) {
+                std::stringstream value(item);
+                long width = 0;
+                std::string extra;
+                if (!(value >> width) || width <= 0 || (value >> extra)) {
+                    throw parse_error(file_name, line_number, "expected comma separated layer widths");
+                }
+                settings.hidden_layers.push_back(size_t(width));
+            }
+            if (settings.hidden_layers.empty()) {
+                throw parse_error(file_name, line_number, "expected at least one hidden layer");
+            }
+        } else if (key == "batch") {
+            long batch = 0;
+            if (!(ss >> batch) || batch < 0) {
+                throw parse_error(file_name, line_number, "expected a batch size, 0 for all mappings");
+            }
+            settings.batch_size = size_t(batch);
+        } else if (key == "best") {
+            std::string mode;
+            if (!(ss >> mode) || (mode != "all" && mode != "batch")) {
+                throw parse_error(file_name, line_number, "expected all or batch");
+            }
+            settings.best_on_all = (mode == "all");
+        } else if (key == "starts") {
+            long starts = 0;
+            if (!(ss >> starts) || starts < 1) {
+                throw parse_error(file_name, line_number, "expected the number of starts to race");
+            }
+            settings.starts = size_t(starts);
+        } else if (key == "seed") {
+            unsigned long seed = 0;
+            if (!(ss >> seed)) {
+                throw parse_error(file_name, line_number, "expected a seed");
+            }
+            settings.seed = uint32_t(seed);
+        } else if (key == "optimizer") {
+            std::string name;
+            ss >> name;
+            if (name == "sgd") {
+                settings.optimizer = optimizer_type::sgd;
+            } else if (name == "momentum") {
+                settings.optimizer = optimizer_type::momentum;
+            } else if (name == "rmsprop") {
+                settings.optimizer = optimizer_type::rmsprop;
+            } else if (name == "adam") {
+                settings.optimizer = optimizer_type::adam;
+            } else {
+                throw parse_error(file_name, line_number, "expected sgd, momentum, rmsprop or adam");
+            }
+        } else if (key == "stop") {
+            std::string test;
+            ss >> test;
+            if (test == "plateau") {
+                long steps = 0;
+                if (!(ss >> steps) || steps < 0) {
+                    throw parse_error(file_name, line_number, "expected a step count");
+                }
+                settings.plateau_iterations = size_t(steps);
+                double tolerance = 0;
+                if (ss >> tolerance) {
+                    if (tolerance < 0 || tolerance >= 1) {
+                        throw parse_error(file_name, line_number, "expected a relative tolerance below 1");
+                    }
+                    settings.plateau_tolerance = tolerance;
+                }
+            } else if (test == "gradient") {
+                if (!(ss >> settings.min_gradient_norm) || settings.min_gradient_norm < 0) {
+                    throw parse_error(file_name, line_number, "expected a gradient norm");
+                }
+            } else if (test == "time") {
+                if (!(ss >> settings.time_budget) || settings.time_budget < 0) {
+                    throw parse_error(file_name, line_number, "expected a time in seconds");
+                }
+            } else {
+                throw parse_error(file_name, line_number, "expected plateau, gradient or time");
+            }
+        } else if (key == "iterations") {
+            long iterations = 0;
+            if (!(ss >> iterations) || iterations < 0) {
+                throw parse_error(file_name, line_number, "expected an iteration count");
+            }
+            settings.max_iterations = size_t(iterations);
+        } else if (key == "lut") {
+            long size = 0;
+            std::string mode;
+            if (!(ss >> size) || (size != 0 && size < 2) || size > 256) {
+                throw parse_error(file_name, line_number, "expected a LUT size");
+            }
+            settings.lut_size = size_t(size);
+            if (ss >> mode) {
+                if (mode != "trilinear" && mode != "tetrahedral") {
+                    throw parse_error(file_name, line_number, "expected trilinear or tetrahedral");
+                }
+                settings.lut_tetrahedral = (mode == "tetrahedral");
+            }
+        } else {
+            std::string target;
+            if (!(ss >> target)) {
+                throw parse_error(file_name, line_number, "expected an input and an output colour");
+            }
+            QColor from(QString::fromStdString(key));
+            QColor to(QString::fromStdString(target));
+            if (!from.isValid() || !to.isValid()) {
+                throw parse_error(file_name, line_number, "invalid colour");
+            }
+            cmap.push_back(std::make_pair(from, to));
+        }
+
+        /* An optional value that did not parse leaves the stream failed
+         * but its text unread, so clear it before looking for leftovers */
+        ss.clear();
+        std::string extra;
+        if (ss >> extra) {
+            throw parse_error(file_name, line_number, "unexpected '" + extra + "'");
+        }
+    }
+
+    if (cmap.empty()) {
+        throw std::runtime_error(file_name + " has no colour mappings");
+    }
+}
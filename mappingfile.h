@@ -0,0 +1,37 @@
+#ifndef __MAPPING_FILE_H__
+#define __MAPPING_FILE_H__
+
+#include "runsettings.h"
+#include <QColor>
+#include <string>
+#include <vector>
+
+/* Reads a text file describing a training run, one entry per line:
+ *
+ *   # comment
+ *   rate 0.01
+ *   layers 16, 16
+ *   batch 0
+ *   best all
+ *   optimizer adam
+ *   starts 8
+ *   seed 1
+ *   iterations 100000
+ *   stop plateau 5000 0.001
+ *   stop gradient 1e-5
+ *   stop time 60
+ *   lut 33 tetrahedral
+ *   #ff0000 #c02020
+ *
+ * Colour lines map an input colour to an output colour and may use any
+ * name QColor understands. "best batch" picks the final parameters by the
+ * error of each training batch instead of the error over every mapping.
+ * The stop lines end training early, once the smoothed error has not
+ * fallen by the given fraction for that many steps, once the gradient norm
+ * is that small, or after that many seconds.
+ * Settings that are not given keep their values.
+ * Throws std::runtime_error naming the line on malformed input, including
+ * anything left over after an entry. */
+void load_mapping_file(const std::string& file_name, std::vector<std::pair<QColor, QColor>>& cmap, run_settings& settings);
+
+#endif /* __MAPPING_FILE_H__ */
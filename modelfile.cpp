@@ -0,0 +1,179 @@
+#include "modelfile.h"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+/* Limits on what is accepted from a file, which keep the size arithmetic
+ * below well away from overflow */
+const uint32_t max_layers = 256;
+const uint32_t max_width = 1 << 16;
+const uint32_t max_lut_size = 256;
+
+bool little_endian() {
+    const uint32_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+uint32_t fnv1a(const unsigned char* data, const size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* The checksum of a file of size bytes, skipping the checksum field */
+uint32_t file_checksum(const unsigned char* data, const size_t size) {
+    const size_t field = offsetof(model_file::header, checksum);
+    const size_t after = field + sizeof(uint32_t);
+    return fnv1a(data + after, size - after, fnv1a(data, field));
+}
+
+uint64_t count_parameters(const uint32_t* widths, const size_t num_widths) {
+    uint64_t count = 0;
+    for (size_t l = 0; l + 1 < num_widths; ++l) {
+        count += uint64_t(widths[l + 1]) * (widths[l] + 1);
+    }
+    return count;
+}
+
+template <typename T>
+void append(std::vector<unsigned char>& buffer, const T& value) {
+    const size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(&buffer[offset], &value, sizeof(T));
+}
+
+}
+
+void save_model_file(const std::string& file_name, const model_data& model) {
+    if (!little_endian()) {
+        throw std::runtime_error("Model files can only be written on little-endian hosts");
+    }
+
+    std::vector<uint32_t> widths(std::begin(model.widths), std::end(model.widths));
+    if (widths.size() < 2 || count_parameters(widths.data(), widths.size()) != model.parameters.size()) {
+        throw std::runtime_error("Model parameters do not match its widths");
+    }
+    if (model.lut_size == 1 || model.lut_size > max_lut_size) {
+        throw std::runtime_error("Model LUT size must be 0 or 2 to 256");
+    }
+
+    std::vector<unsigned char> payload;
+    for (const uint32_t width : widths) {
+        append(payload, width);
+    }
+    for (const float parameter : model.parameters) {
+        append(payload, parameter);
+    }
+    for (const auto& mapping : model.cmap) {
+        append(payload, float(mapping.first.redF()));
+        append(payload, float(mapping.first.greenF()));
+        append(payload, float(mapping.first.blueF()));
+        append(payload, float(mapping.second.redF()));
+        append(payload, float(mapping.second.greenF()));
+        append(payload, float(mapping.second.blueF()));
+    }
+
+    model_file::header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, model_file::magic, sizeof(header.magic));
+    header.version = model_file::version;
+    header.header_size = sizeof(header);
+    header.num_widths = uint32_t(widths.size());
+    header.num_parameters = uint32_t(model.parameters.size());
+    header.num_mappings = uint32_t(model.cmap.size());
+    header.optimizer = uint32_t(model.optimizer);
+    header.iterations = model.iterations;
+    header.best_error = model.best_error;
+    header.learning_rate = model.learning_rate;
+    header.batch_size = uint32_t(model.batch_size);
+    header.lut_size = uint32_t(model.lut_size);
+    header.flags = model.lut_tetrahedral ? model_file::flag_tetrahedral : 0;
+
+    std::vector<unsigned char> contents(sizeof(header));
+    std::memcpy(contents.data(), &header, sizeof(header));
+    contents.insert(contents.end(), payload.begin(), payload.end());
+    header.checksum = file_checksum(contents.data(), contents.size());
+    std::memcpy(contents.data() + offsetof(model_file::header, checksum), &header.checksum, sizeof(header.checksum));
+
+    std::ofstream file(file_name, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(contents.data()), std::streamsize(contents.size()));
+    if (!file) {
+        throw std::runtime_error("Cannot write " + file_name);
+    }
+}
+
+mapped_model::mapped_model(const std::string& file_name) : file_(QString::fromStdString(file_name)) {
+    if (!little_endian()) {
+        throw std::runtime_error("Model files can only be read on little-endian hosts");
+    }
+    if (!file_.open(QIODevice::ReadOnly)) {
+        throw std::runtime_error("Cannot open " + file_name);
+    }
+
+    const uint64_t size = uint64_t(file_.size());
+    if (size < sizeof(model_file::header)) {
+        throw std::runtime_error(file_name + " is not a model file");
+    }
+    const unsigned char* data = file_.map(0, qint64(size));
+    if (!data) {
+        throw std::runtime_error("Cannot map " + file_name);
+    }
+
+    header_ = reinterpret_cast<const model_file::header*>(data);
+    if (std::memcmp(header_->magic, model_file::magic, sizeof(model_file::magic)) != 0) {
+        throw std::runtime_error(file_name + " is not a model file");
+    }
+    if (header_->version == 0 || header_->version > model_file::version) {
+        throw std::runtime_error(file_name + " needs a newer version of qtmixer");
+    }
+    if (header_->header_size < sizeof(model_file::header) || header_->header_size % 4 != 0 || header_->header_size > size) {
+        throw std::runtime_error(file_name + " has a bad header");
+    }
+
+    /* Checked before the header's contents are trusted any further */
+    const uint32_t checksum = header_->version == 1 ? fnv1a(data + header_->header_size, size_t(size - header_->header_size)) : file_checksum(data, size_t(size));
+    if (checksum != header_->checksum) {
+        throw std::runtime_error(file_name + " is corrupt");
+    }
+
+    if (header_->lut_size == 1 || header_->lut_size > max_lut_size) {
+        throw std::runtime_error(file_name + " has a bad LUT size");
+    }
+    if ((header_->flags & ~model_file::known_flags) != 0) {
+        throw std::runtime_error(file_name + " uses features this version of qtmixer does not know");
+    }
+
+    const uint64_t widths_size = uint64_t(header_->num_widths) * sizeof(uint32_t);
+    const uint64_t parameters_size = uint64_t(header_->num_parameters) * sizeof(float);
+    const uint64_t mappings_size = uint64_t(header_->num_mappings) * 6 * sizeof(float);
+    if (header_->num_widths < 2 || header_->num_widths > max_layers || header_->header_size + widths_size + parameters_size + mappings_size != size) {
+        throw std::runtime_error(file_name + " is truncated or has a bad header");
+    }
+
+    const unsigned char* payload = data + header_->header_size;
+    widths_ = reinterpret_cast<const uint32_t*>(payload);
+    parameters_ = reinterpret_cast<const float*>(payload + widths_size);
+
+    for (uint32_t l = 0; l < header_->num_widths; ++l) {
+        if (widths_[l] == 0 || widths_[l] > max_width) {
+            throw std::runtime_error(file_name + " has a bad layer width");
+        }
+    }
+    if (widths_[0] != 3 || widths_[header_->num_widths - 1] != 3 || count_parameters(widths_, header_->num_widths) != header_->num_parameters) {
+        throw std::runtime_error(file_name + " does not hold a colour network");
+    }
+}
+
+std::vector<size_t> mapped_model::widths() const {
+    return std::vector<size_t>(widths_, widths_ + header_->num_widths);
+}
+
+std::shared_ptr<pixel_kernel> mapped_model::kernel() const {
+    return std::make_shared<pixel_kernel>(widths(), std::vector<float>(parameters_, parameters_ + header_->num_parameters));
+}
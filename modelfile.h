@@ -0,0 +1,108 @@
+#ifndef __MODEL_FILE_H__
+#define __MODEL_FILE_H__
+
+#include "pixelkernel.h"
+#include "trainer.h"
+#include <QColor>
+#include <QFile>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* A trained colour network and what it was trained on. */
+struct model_data {
+    model_data() : optimizer(optimizer_type::sgd), learning_rate(0), batch_size(0), iterations(0), best_error(0), lut_size(0), lut_tetrahedral(false) {
+    }
+
+    std::vector<size_t> widths;
+    std::vector<float> parameters; /* dense_network layout */
+    std::vector<std::pair<QColor, QColor>> cmap;
+    optimizer_type optimizer;
+    double learning_rate;
+    size_t batch_size;
+    uint64_t iterations;
+    double best_error;
+    size_t lut_size; /* 0 when the network was applied directly */
+    bool lut_tetrahedral;
+};
+
+/* Binary model files.
+ *
+ * A fixed size little-endian header is followed by the layer widths as
+ * uint32, the parameters as float and each mapping as six floats (input
+ * then output RGB in [0, 1]). Every section is 4-byte aligned, so a
+ * mapped file is read in place. The header carries a version and its own
+ * size, so later versions can append fields, and a checksum of the whole
+ * file apart from the checksum itself. Version 1 files, whose checksum
+ * covers only the data after the header, are still read. */
+namespace model_file {
+
+const char magic[8] = { 'Q', 'T', 'M', 'I', 'X', 'M', 'D', 'L' };
+const uint32_t version = 2;
+
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t num_widths;
+    uint32_t num_parameters;
+    uint32_t num_mappings;
+    uint32_t optimizer;
+    uint64_t iterations;
+    double best_error;
+    double learning_rate;
+    uint32_t batch_size;
+    uint32_t lut_size;
+    uint32_t flags;
+    uint32_t checksum; /* FNV-1a over every other byte of the file */
+};
+
+static_assert(sizeof(header) == 72, "model_file::header must match the on-disk layout");
+
+const uint32_t flag_tetrahedral = 1;
+
+/* Every flag this version understands; files with others are rejected */
+const uint32_t known_flags = flag_tetrahedral;
+
+}
+
+/* Writes model to file_name. Throws std::runtime_error on failure. */
+void save_model_file(const std::string& file_name, const model_data& model);
+
+/* A model file mapped into memory. Opening checks the header, sizes and
+ * checksum but copies nothing; the accessors point into the mapping,
+ * which lives as long as the object. Throws std::runtime_error if the
+ * file cannot be mapped or is not a valid model. */
+class mapped_model {
+public:
+    explicit mapped_model(const std::string& file_name);
+
+    mapped_model(const mapped_model&) = delete;
+    mapped_model& operator=(const mapped_model&) = delete;
+
+    const model_file::header& header() const {
+        return *header_;
+    }
+
+    std::vector<size_t> widths() const;
+
+    const float* parameters() const {
+        return parameters_;
+    }
+
+    size_t num_parameters() const {
+        return header_->num_parameters;
+    }
+
+    /* The inference kernel for the stored network */
+    std::shared_ptr<pixel_kernel> kernel() const;
+
+private:
+    QFile file_;
+    const model_file::header* header_;
+    const uint32_t* widths_;
+    const float* parameters_;
+};
+
+#endif /* __MODEL_FILE_H__ */
@@ -0,0 +1,171 @@
+#include "network.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/* Samples processed together so each weight row is reused from cache */
+const size_t sample_block = 8;
+
+}
+
+dense_network::dense_network() : max_width_(0) {
+}
+
+dense_network::dense_network(const std::vector<size_t>& widths) : widths_(widths), max_width_(0) {
+    if (widths_.size() < 2) {
+        throw std::runtime_error("Network needs at least an input and an output layer");
+    }
+    size_t offset = 0;
+    for (size_t l = 0; l < widths_.size(); ++l) {
+        if (widths_[l] == 0) {
+            throw std::runtime_error("Network layers cannot be empty");
+        }
+        max_width_ = std::max(max_width_, widths_[l]);
+        if (l + 1 < widths_.size()) {
+            offsets_.push_back(offset);
+            offset += widths_[l + 1] * (widths_[l] + 1);
+        }
+    }
+    parameters_.resize(offset);
+}
+
+const double* dense_network::forward(dense_workspace& workspace, const double* inputs, const size_t count) const {
+    if (count > workspace.capacity_ || workspace.activations_.size() != widths_.size()) {
+        throw std::runtime_error("Workspace does not fit the network");
+    }
+
+    std::copy(inputs, inputs + count * num_inputs(), workspace.activations_[0].data());
+
+    for (size_t l = 0; l < num_layers(); ++l) {
+        const size_t in = widths_[l];
+        const size_t out = widths_[l + 1];
+        const bool hidden = l + 1 < num_layers();
+        const double* weights = &parameters_[offsets_[l]];
+        const double* a = workspace.activations_[l].data();
+        double* z = workspace.activations_[l + 1].data();
+
+        for (size_t begin = 0; begin < count; begin += sample_block) {
+            const size_t end = std::min(count, begin + sample_block);
+            for (size_t o = 0; o < out; ++o) {
+                const double* w = weights + o * (in + 1);
+                for (size_t i = begin; i < end; ++i) {
+                    const double* x = a + i * in;
+                    double acc = w[in];
+                    for (size_t j = 0; j < in; ++j) {
+                        acc += w[j] * x[j];
+                    }
+                    z[i * out + o] = hidden ? std::tanh(acc) : acc;
+                }
+            }
+        }
+    }
+
+    return workspace.activations_.back().data();
+}
+
+double dense_network::backward(dense_workspace& workspace, const double* targets, const size_t count, double* gradient) const {
+    const size_t outputs = num_outputs();
+    const double* result = workspace.activations_.back().data();
+    double* delta = workspace.delta_.data();
+    double* next_delta = workspace.next_delta_.data();
+
+    /* d/dz (z - t)^2 = 2(z - t) */
+    double error = 0;
+    for (size_t i = 0; i < count * outputs; ++i) {
+        const double difference = result[i] - targets[i];
+        error += difference * difference;
+        delta[i] = 2 * difference;
+    }
+
+    for (size_t l = num_layers(); l-- > 0;) {
+        const size_t in = widths_[l];
+        const size_t out = widths_[l + 1];
+        const double* weights = &parameters_[offsets_[l]];
+        double* layer_gradient = gradient + offsets_[l];
+        const double* a = workspace.activations_[l].data();
+
+        /* dE/dW = delta^T A, dE/db = sum of delta */
+        for (size_t begin = 0; begin < count; begin += sample_block) {
+            const size_t end = std::min(count, begin + sample_block);
+            for (size_t o = 0; o < out; ++o) {
+                double* g = layer_gradient + o * (in + 1);
+                for (size_t i = begin; i < end; ++i) {
+                    const double d = delta[i * out + o];
+                    const double* x = a + i * in;
+                    for (size_t j = 0; j < in; ++j) {
+                        g[j] += d * x[j];
+                    }
+                    g[in] += d;
+                }
+            }
+        }
+
+        if (l == 0) {
+            break;
+        }
+
+        /* dE/dA = delta W, then through tanh: d/dx tanh(x) = 1 - tanh^2(x) */
+        for (size_t i = 0; i < count; ++i) {
+            double* nd = next_delta + i * in;
+            std::fill(nd, nd + in, 0.0);
+            for (size_t o = 0; o < out; ++o) {
+                const double d = delta[i * out + o];
+                const double* w = weights + o * (in + 1);
+                for (size_t j = 0; j < in; ++j) {
+                    nd[j] += d * w[j];
+                }
+            }
+            const double* x = a + i * in;
+            for (size_t j = 0; j < in; ++j) {
+                nd[j] *= 1 - x[j] * x[j];
+            }
+        }
+
+        std::swap(delta, next_delta);
+    }
+
+    return error;
+}
+
+std::string dense_network::glsl() const {
+    static const char* channels[] = { "col.r", "col.g", "col.b" };
+    std::stringstream ss;
+    for (size_t l = 0; l < num_layers(); ++l) {
+        const size_t in = widths_[l];
+        const size_t out = widths_[l + 1];
+        const bool hidden = l + 1 < num_layers();
+        const double* weights = &parameters_[offsets_[l]];
+        ss << "float a" << (l + 1) << "[" << out << "];" << std::endl;
+        for (size_t o = 0; o < out; ++o) {
+            const double* w = weights + o * (in + 1);
+            ss << "a" << (l + 1) << "[" << o << "] = " << (hidden ? "tanh(" : "");
+            for (size_t j = 0; j < in; ++j) {
+                ss << w[j] << " * ";
+                if (l == 0 && in <= 3) {
+                    ss << channels[j];
+                } else {
+                    ss << "a" << l << "[" << j << "]";
+                }
+                ss << " + ";
+            }
+            ss << w[in] << (hidden ? ")" : "") << ";" << std::endl;
+        }
+    }
+    const size_t last = num_layers();
+    ss << "col = vec3(a" << last << "[0], a" << last << "[1], a" << last << "[2]);";
+    return ss.str();
+}
+
+dense_workspace::dense_workspace() : capacity_(0) {
+}
+
+dense_workspace::dense_workspace(const dense_network& network, const size_t capacity) : capacity_(capacity) {
+    for (size_t l = 0; l < network.widths().size(); ++l) {
+        activations_.emplace_back(capacity * network.widths()[l]);
+    }
+    delta_.resize(capacity * network.max_width());
+    next_delta_.resize(capacity * network.max_width());
+}
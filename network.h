@@ -0,0 +1,103 @@
+#ifndef __NETWORK_H__
+#define __NETWORK_H__
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+class dense_workspace;
+
+/* A fully connected network stored as one contiguous weight matrix per
+ * layer. widths holds the number of units in each layer, inputs first and
+ * outputs last; hidden layers use tanh and the output layer is linear.
+ *
+ * All weights live in a single flat parameter vector. Each layer is a
+ * row-major matrix with one row per unit, holding the weights for every
+ * input followed by the bias (the same layout as bp_layer::parameters_). */
+class dense_network {
+public:
+    dense_network();
+
+    explicit dense_network(const std::vector<size_t>& widths);
+
+    const std::vector<size_t>& widths() const {
+        return widths_;
+    }
+
+    size_t num_layers() const {
+        return widths_.size() - 1;
+    }
+
+    size_t num_inputs() const {
+        return widths_.front();
+    }
+
+    size_t num_outputs() const {
+        return widths_.back();
+    }
+
+    size_t max_width() const {
+        return max_width_;
+    }
+
+    size_t num_parameters() const {
+        return parameters_.size();
+    }
+
+    std::vector<double>& parameters() {
+        return parameters_;
+    }
+
+    const std::vector<double>& parameters() const {
+        return parameters_;
+    }
+
+    /* Offset of the weight matrix for layer (0 = first hidden layer). */
+    size_t layer_offset(const size_t layer) const {
+        return offsets_[layer];
+    }
+
+    /* Forward pass over count samples. inputs is row-major, one row of
+     * num_inputs() per sample. Returns the outputs, one row of
+     * num_outputs() per sample, which stay valid until the workspace is
+     * reused. */
+    const double* forward(dense_workspace& workspace, const double* inputs, const size_t count) const;
+
+    /* Backward pass for the squared error sum_i |output_i - target_i|^2
+     * against the last forward pass on workspace. The derivative with
+     * respect to every parameter is added to gradient. Returns the error. */
+    double backward(dense_workspace& workspace, const double* targets, const size_t count, double* gradient) const;
+
+    /* GLSL snippet that maps vec3 col through the network in place. */
+    std::string glsl() const;
+
+private:
+    std::vector<size_t> widths_;
+    std::vector<size_t> offsets_;
+    std::vector<double> parameters_;
+    size_t max_width_;
+};
+
+/* Scratch space for forward and backward passes over up to capacity
+ * samples. Workspaces are not shared between threads; each thread that
+ * evaluates a network needs its own. */
+class dense_workspace {
+public:
+    dense_workspace();
+
+    dense_workspace(const dense_network& network, const size_t capacity);
+
+    size_t capacity() const {
+        return capacity_;
+    }
+
+private:
+    friend class dense_network;
+
+    size_t capacity_;
+    std::vector<std::vector<double>> activations_; /* per layer, capacity x width */
+    std::vector<double> delta_;
+    std::vector<double> next_delta_;
+};
+
+#endif /* __NETWORK_H__ */
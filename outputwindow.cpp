@@ -1,22 +1,56 @@
 #include "outputwindow.h"
 #include "ui_outputwindow.h"
+#include <QFileDialog>
+#include <QMessageBox>
+#include <fstream>
 
-OutputWindow::OutputWindow(const QPixmap& pixmap, const std::string& glsl, QWidget *parent) :
+OutputWindow::OutputWindow(const image_pyramid& source, const image_pyramid& result, const std::string& glsl, const std::string& cube, const model_data& model, QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::OutputWindow)
+    ui(new Ui::OutputWindow),
+    cube_(cube),
+    model_(model)
 {
     ui->setupUi(this);
 
     setWindowTitle("Output Viewer");
 
-    ui->label->setStyleSheet("QLabel { background-color : white; }");
-
-    ui->label->setPixmap(pixmap);
+    ui->view->setPyramid(source);
+    ui->view->setComparison(result);
 
     ui->code->setPlainText(glsl.c_str());
+
+    ui->saveCubeButton->setEnabled(!cube_.empty());
+    connect(ui->saveCubeButton, &QPushButton::clicked, this, &OutputWindow::saveCubeClick);
+
+    ui->saveModelButton->setEnabled(!model_.parameters.empty());
+    connect(ui->saveModelButton, &QPushButton::clicked, this, &OutputWindow::saveModelClick);
 }
 
 OutputWindow::~OutputWindow()
 {
     delete ui;
 }
+
+void OutputWindow::saveCubeClick() {
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save LUT"), "", tr("Cube LUT (*.cube)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    std::ofstream file(fileName.toStdString());
+    file << cube_;
+    if (!file) {
+        QMessageBox::warning(this, tr("Save LUT"), tr("Could not write %1").arg(fileName));
+    }
+}
+
+void OutputWindow::saveModelClick() {
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Model"), "", tr("qtmixer model (*.qtmodel)"));
+    if (fileName.isEmpty()) {
+        return;
+    }
+    try {
+        save_model_file(fileName.toStdString(), model_);
+    } catch (const std::exception& e) {
+        QMessageBox::warning(this, tr("Save Model"), QString::fromStdString(e.what()));
+    }
+}
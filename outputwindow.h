@@ -1,8 +1,9 @@
 #ifndef OUTPUTWINDOW_H
 #define OUTPUTWINDOW_H
 
+#include "modelfile.h"
+#include "imagepyramid.h"
 #include <QMainWindow>
-#include <QPixmap>
 
 namespace Ui {
 class OutputWindow;
@@ -13,11 +14,17 @@ class OutputWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit OutputWindow(const QPixmap& pixmap, const std::string& glsl, QWidget *parent = nullptr);
+    /* source is shown left of the divider and result right of it */
+    OutputWindow(const image_pyramid& source, const image_pyramid& result, const std::string& glsl, const std::string& cube, const model_data& model, QWidget *parent = nullptr);
     ~OutputWindow();
 
 private:
+    void saveCubeClick();
+    void saveModelClick();
+
     Ui::OutputWindow *ui;
+    std::string cube_;
+    model_data model_;
 };
 
 #endif // OUTPUTWINDOW_H
@@ -0,0 +1,249 @@
+#include "pixelkernel.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PIXEL_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/* tanh(x) ~= x(135135 + 17325x^2 + 378x^4 + x^6) / (135135 + 62370x^2 + 3150x^4 + 28x^6)
+ * This is the [7/6] Pade approximant of the continued fraction for tanh. The
+ * input is clamped to +/-4.8, where the approximant meets tanh to within
+ * 7.3e-5, and the result is clamped to [-1, 1]. */
+const float tanh_clamp = 4.8f;
+const float tanh_p0 = 135135.0f;
+const float tanh_p1 = 17325.0f;
+const float tanh_p2 = 378.0f;
+const float tanh_q1 = 62370.0f;
+const float tanh_q2 = 3150.0f;
+const float tanh_q3 = 28.0f;
+
+/* Widest block processed by any code path, in pixels */
+const size_t max_block = 8;
+
+float clamp_unit(const float x) {
+    return std::min(1.0f, std::max(0.0f, x));
+}
+
+}
+
+pixel_kernel::pixel_kernel() : max_width_(0), isa_(isa_scalar) {
+}
+
+pixel_kernel::pixel_kernel(const std::vector<size_t>& widths, const std::vector<float>& parameters) : widths_(widths), parameters_(parameters), max_width_(0) {
+    if (widths_.size() < 2 || widths_.front() != num_channels || widths_.back() != num_channels) {
+        throw std::runtime_error("Kernel needs three input and three output channels");
+    }
+    size_t offset = 0;
+    for (size_t l = 0; l + 1 < widths_.size(); ++l) {
+        offsets_.push_back(offset);
+        offset += widths_[l + 1] * (widths_[l] + 1);
+        max_width_ = std::max(max_width_, widths_[l + 1]);
+    }
+    if (parameters_.size() != offset) {
+        throw std::runtime_error("Kernel weights do not match the layer widths");
+    }
+    isa_ = detect_isa();
+}
+
+float pixel_kernel::tanh_approx(const float x) {
+    const float c = std::min(tanh_clamp, std::max(-tanh_clamp, x));
+    const float c2 = c * c;
+    const float p = c * (tanh_p0 + c2 * (tanh_p1 + c2 * (tanh_p2 + c2)));
+    const float q = tanh_p0 + c2 * (tanh_q1 + c2 * (tanh_q2 + c2 * tanh_q3));
+    return std::min(1.0f, std::max(-1.0f, p / q));
+}
+
+pixel_kernel::kernel_isa pixel_kernel::detect_isa() {
+#ifdef PIXEL_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return isa_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return isa_sse2;
+    }
+#endif
+    return isa_scalar;
+}
+
+const char* pixel_kernel::isa() const {
+    switch (isa_) {
+    case isa_avx2:
+        return "avx2";
+    case isa_sse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void pixel_kernel::apply(const float* const input[num_channels], float* const output[num_channels], const size_t count) const {
+    std::vector<float> scratch(2 * max_width_ * max_block);
+    size_t done = 0;
+    if (isa_ == isa_avx2) {
+        done = apply_avx2(input, output, count, scratch.data());
+    } else if (isa_ == isa_sse2) {
+        done = apply_sse2(input, output, count, scratch.data());
+    }
+    apply_scalar(input, output, done, count, scratch.data());
+}
+
+size_t pixel_kernel::apply_scalar(const float* const input[num_channels], float* const output[num_channels], const size_t begin, const size_t end, float* scratch) const {
+    const size_t num_layers = widths_.size() - 1;
+    for (size_t i = begin; i < end; ++i) {
+        float* a = scratch;
+        float* b = scratch + max_width_;
+        for (size_t c = 0; c < num_channels; ++c) {
+            a[c] = input[c][i];
+        }
+        for (size_t l = 0; l < num_layers; ++l) {
+            const size_t in = widths_[l];
+            const size_t out = widths_[l + 1];
+            const bool hidden = l + 1 < num_layers;
+            const float* weights = &parameters_[offsets_[l]];
+            for (size_t o = 0; o < out; ++o) {
+                const float* w = weights + o * (in + 1);
+                float acc = w[in];
+                for (size_t j = 0; j < in; ++j) {
+                    acc += w[j] * a[j];
+                }
+                b[o] = hidden ? tanh_approx(acc) : clamp_unit(acc);
+            }
+            std::swap(a, b);
+        }
+        for (size_t c = 0; c < num_channels; ++c) {
+            output[c][i] = a[c];
+        }
+    }
+    return end;
+}
+
+#ifdef PIXEL_KERNEL_X86
+
+namespace {
+
+__attribute__((target("sse2")))
+inline __m128 tanh_sse2(__m128 x) {
+    x = _mm_min_ps(_mm_set1_ps(tanh_clamp), _mm_max_ps(_mm_set1_ps(-tanh_clamp), x));
+    const __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_add_ps(_mm_set1_ps(tanh_p2), x2);
+    p = _mm_add_ps(_mm_set1_ps(tanh_p1), _mm_mul_ps(x2, p));
+    p = _mm_add_ps(_mm_set1_ps(tanh_p0), _mm_mul_ps(x2, p));
+    p = _mm_mul_ps(x, p);
+    __m128 q = _mm_add_ps(_mm_set1_ps(tanh_q2), _mm_mul_ps(x2, _mm_set1_ps(tanh_q3)));
+    q = _mm_add_ps(_mm_set1_ps(tanh_q1), _mm_mul_ps(x2, q));
+    q = _mm_add_ps(_mm_set1_ps(tanh_p0), _mm_mul_ps(x2, q));
+    const __m128 r = _mm_div_ps(p, q);
+    return _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_set1_ps(-1.0f), r));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256 tanh_avx2(__m256 x) {
+    x = _mm256_min_ps(_mm256_set1_ps(tanh_clamp), _mm256_max_ps(_mm256_set1_ps(-tanh_clamp), x));
+    const __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_add_ps(_mm256_set1_ps(tanh_p2), x2);
+    p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(tanh_p1));
+    p = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(tanh_p0));
+    p = _mm256_mul_ps(x, p);
+    __m256 q = _mm256_fmadd_ps(x2, _mm256_set1_ps(tanh_q3), _mm256_set1_ps(tanh_q2));
+    q = _mm256_fmadd_ps(x2, q, _mm256_set1_ps(tanh_q1));
+    q = _mm256_fmadd_ps(x2, q, _mm256_set1_ps(tanh_p0));
+    const __m256 r = _mm256_div_ps(p, q);
+    return _mm256_min_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(_mm256_set1_ps(-1.0f), r));
+}
+
+}
+
+__attribute__((target("sse2")))
+size_t pixel_kernel::apply_sse2(const float* const input[num_channels], float* const output[num_channels], const size_t count, float* scratch) const {
+    const size_t num_layers = widths_.size() - 1;
+    const size_t width = 4;
+    size_t i = 0;
+    for (; i + width <= count; i += width) {
+        float* a = scratch;
+        float* b = scratch + max_width_ * width;
+        for (size_t c = 0; c < num_channels; ++c) {
+            _mm_storeu_ps(a + c * width, _mm_loadu_ps(input[c] + i));
+        }
+        __m128 out[num_channels];
+        for (size_t l = 0; l < num_layers; ++l) {
+            const size_t in = widths_[l];
+            const size_t units = widths_[l + 1];
+            const bool hidden = l + 1 < num_layers;
+            const float* weights = &parameters_[offsets_[l]];
+            for (size_t o = 0; o < units; ++o) {
+                const float* w = weights + o * (in + 1);
+                __m128 acc = _mm_set1_ps(w[in]);
+                for (size_t j = 0; j < in; ++j) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[j]), _mm_loadu_ps(a + j * width)));
+                }
+                if (hidden) {
+                    _mm_storeu_ps(b + o * width, tanh_sse2(acc));
+                } else {
+                    out[o] = _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), acc));
+                }
+            }
+            std::swap(a, b);
+        }
+        /* Outputs are stored last so that input and output may alias */
+        for (size_t c = 0; c < num_channels; ++c) {
+            _mm_storeu_ps(output[c] + i, out[c]);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2,fma")))
+size_t pixel_kernel::apply_avx2(const float* const input[num_channels], float* const output[num_channels], const size_t count, float* scratch) const {
+    const size_t num_layers = widths_.size() - 1;
+    const size_t width = 8;
+    size_t i = 0;
+    for (; i + width <= count; i += width) {
+        float* a = scratch;
+        float* b = scratch + max_width_ * width;
+        for (size_t c = 0; c < num_channels; ++c) {
+            _mm256_storeu_ps(a + c * width, _mm256_loadu_ps(input[c] + i));
+        }
+        __m256 out[num_channels];
+        for (size_t l = 0; l < num_layers; ++l) {
+            const size_t in = widths_[l];
+            const size_t units = widths_[l + 1];
+            const bool hidden = l + 1 < num_layers;
+            const float* weights = &parameters_[offsets_[l]];
+            for (size_t o = 0; o < units; ++o) {
+                const float* w = weights + o * (in + 1);
+                __m256 acc = _mm256_set1_ps(w[in]);
+                for (size_t j = 0; j < in; ++j) {
+                    acc = _mm256_fmadd_ps(_mm256_set1_ps(w[j]), _mm256_loadu_ps(a + j * width), acc);
+                }
+                if (hidden) {
+                    _mm256_storeu_ps(b + o * width, tanh_avx2(acc));
+                } else {
+                    out[o] = _mm256_min_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(_mm256_setzero_ps(), acc));
+                }
+            }
+            std::swap(a, b);
+        }
+        /* Outputs are stored last so that input and output may alias */
+        for (size_t c = 0; c < num_channels; ++c) {
+            _mm256_storeu_ps(output[c] + i, out[c]);
+        }
+    }
+    return i;
+}
+
+#else
+
+size_t pixel_kernel::apply_sse2(const float* const[num_channels], float* const[num_channels], const size_t, float*) const {
+    return 0;
+}
+
+size_t pixel_kernel::apply_avx2(const float* const[num_channels], float* const[num_channels], const size_t, float*) const {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __PIXEL_KERNEL_H__
+#define __PIXEL_KERNEL_H__
+
+#include "pixeltransform.h"
+#include <vector>
+#include <cstddef>
+
+/* Batched inference for the trained colour network: tanh hidden layers
+ * followed by a linear output layer, three channels in and three out.
+ * Pixels are passed as structure-of-arrays blocks (one array per channel)
+ * and processed 8 at a time with AVX2, 4 at a time with SSE2, or one at a
+ * time on other targets. The instruction set is picked at runtime.
+ *
+ * widths and parameters use the same layout as dense_network: one
+ * row-major matrix per layer with one row per unit, inputs first and the
+ * bias last. */
+class pixel_kernel : public pixel_transform {
+public:
+    pixel_kernel();
+
+    pixel_kernel(const std::vector<size_t>& widths, const std::vector<float>& parameters);
+
+    const std::vector<size_t>& widths() const {
+        return widths_;
+    }
+
+    void apply(const float* const input[num_channels], float* const output[num_channels], const size_t count) const override;
+
+    /* Name of the instruction set selected for apply(). */
+    const char* isa() const;
+
+    /* Rational approximation of tanh used by every code path, so that the
+     * scalar and vector results agree. Absolute error is below 1e-4 for all
+     * x, which is well under half an 8-bit quantisation step. */
+    static float tanh_approx(const float x);
+
+private:
+    enum kernel_isa {
+        isa_scalar,
+        isa_sse2,
+        isa_avx2
+    };
+
+    static kernel_isa detect_isa();
+
+    /* Each returns the number of pixels processed; the scratch buffers hold
+     * two layers of activations for one block of pixels. */
+    size_t apply_scalar(const float* const input[num_channels], float* const output[num_channels], const size_t begin, const size_t end, float* scratch) const;
+    size_t apply_sse2(const float* const input[num_channels], float* const output[num_channels], const size_t count, float* scratch) const;
+    size_t apply_avx2(const float* const input[num_channels], float* const output[num_channels], const size_t count, float* scratch) const;
+
+    std::vector<size_t> widths_;
+    std::vector<size_t> offsets_;
+    std::vector<float> parameters_;
+    size_t max_width_;
+    kernel_isa isa_;
+};
+
+#endif /* __PIXEL_KERNEL_H__ */
@@ -0,0 +1,19 @@
+#ifndef __PIXEL_TRANSFORM_H__
+#define __PIXEL_TRANSFORM_H__
+
+#include <cstddef>
+
+/* A colour to colour mapping applied to structure-of-arrays blocks of
+ * pixels, one float array per channel with values in [0, 1]. */
+class pixel_transform {
+public:
+    static const size_t num_channels = 3;
+
+    virtual ~pixel_transform() = default;
+
+    /* Maps count pixels, reading input[c][i] and writing output[c][i]
+     * clamped to [0, 1]. Input and output may alias. */
+    virtual void apply(const float* const input[num_channels], float* const output[num_channels], const size_t count) const = 0;
+};
+
+#endif /* __PIXEL_TRANSFORM_H__ */
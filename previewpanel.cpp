@@ -0,0 +1,29 @@
+#include "previewpanel.h"
+#include "ui_previewpanel.h"
+
+PreviewPanel::PreviewPanel(QWidget *parent) :
+    QDockWidget(parent),
+    ui(new Ui::PreviewPanel)
+{
+    QWidget* container = new QWidget(this);
+    ui->setupUi(container);
+    setWidget(container);
+
+    setWindowTitle(tr("Preview"));
+
+    clear();
+}
+
+PreviewPanel::~PreviewPanel()
+{
+    delete ui;
+}
+
+void PreviewPanel::setPreview(const QImage& image) {
+    ui->preview->setPixmap(QPixmap::fromImage(image));
+}
+
+void PreviewPanel::clear() {
+    ui->preview->setPixmap(QPixmap());
+    ui->preview->setText("No preview");
+}
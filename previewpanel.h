@@ -0,0 +1,27 @@
+#ifndef PREVIEWPANEL_H
+#define PREVIEWPANEL_H
+
+#include <QDockWidget>
+#include <QImage>
+
+namespace Ui {
+class PreviewPanel;
+}
+
+class PreviewPanel : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    explicit PreviewPanel(QWidget *parent = nullptr);
+    ~PreviewPanel();
+
+    void setPreview(const QImage& image);
+
+    void clear();
+
+private:
+    Ui::PreviewPanel *ui;
+};
+
+#endif // PREVIEWPANEL_H
@@ -0,0 +1,69 @@
+#include "previewworker.h"
+#include "imageapply.h"
+#include "pixelkernel.h"
+#include <functional>
+
+preview_worker::preview_worker(const QImage& proxy) : proxy_(prepare_image(proxy)), pending_(false), quit_(false), has_result_(false) {
+    cancel_ = false;
+    thread_ = std::make_shared<std::thread>(std::bind(&preview_worker::thread_function, this));
+}
+
+preview_worker::~preview_worker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        quit_ = true;
+        cancel_ = true;
+    }
+    wake_.notify_one();
+    thread_->join();
+}
+
+void preview_worker::submit(const std::vector<size_t>& widths, const std::vector<double>& parameters) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        widths_ = widths;
+        parameters_ = parameters;
+        pending_ = true;
+        cancel_ = true; /* whatever is rendering now is stale */
+    }
+    wake_.notify_one();
+}
+
+bool preview_worker::take_result(QImage& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_result_) {
+        return false;
+    }
+    image = result_;
+    result_ = QImage();
+    has_result_ = false;
+    return true;
+}
+
+void preview_worker::thread_function() {
+    while (true) {
+        std::vector<size_t> widths;
+        std::vector<float> parameters;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return pending_ || quit_; });
+            if (quit_) {
+                return;
+            }
+            widths = widths_;
+            parameters.assign(std::begin(parameters_), std::end(parameters_));
+            pending_ = false;
+            cancel_ = false;
+        }
+
+        const pixel_kernel kernel(widths, parameters);
+        QImage image = proxy_.copy();
+        apply_direct(kernel, image, cancel_);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cancel_) {
+            result_ = image;
+            has_result_ = true;
+        }
+    }
+}
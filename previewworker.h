@@ -0,0 +1,45 @@
+#ifndef __PREVIEW_WORKER_H__
+#define __PREVIEW_WORKER_H__
+
+#include <QImage>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Renders a small proxy image with a network on a background thread.
+ *
+ * Only the most recent submission matters: submitting a new model cancels
+ * a render in progress and replaces any that has not started, so the
+ * preview never falls behind the training. */
+class preview_worker {
+public:
+    explicit preview_worker(const QImage& proxy);
+
+    ~preview_worker();
+
+    /* Queues a render with the given dense_network layout and weights */
+    void submit(const std::vector<size_t>& widths, const std::vector<double>& parameters);
+
+    /* Moves a finished render into image; returns false if none is ready */
+    bool take_result(QImage& image);
+
+private:
+    void thread_function();
+
+    QImage proxy_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<size_t> widths_;
+    std::vector<double> parameters_;
+    bool pending_;
+    bool quit_;
+    QImage result_;
+    bool has_result_;
+    std::atomic<bool> cancel_;
+    std::shared_ptr<std::thread> thread_;
+};
+
+#endif /* __PREVIEW_WORKER_H__ */
@@ -0,0 +1,30 @@
+QT       += core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = qtmixer-bench
+
+QMAKE_CXXFLAGS+= -fopenmp
+QMAKE_LFLAGS +=  -fopenmp
+
+SOURCES += \
+    bench.cpp \
+    colourcache.cpp \
+    colourlut.cpp \
+    fixednetwork.cpp \
+    imageapply.cpp \
+    network.cpp \
+    pixelkernel.cpp \
+    trainer.cpp
+
+HEADERS += \
+    colourcache.h \
+    colourlut.h \
+    fixednetwork.h \
+    graph.h \
+    imageapply.h \
+    network.h \
+    pixelkernel.h \
+    pixeltransform.h \
+    trainer.h
@@ -0,0 +1,46 @@
+QT       += core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = qtmixer-cli
+
+QMAKE_CXXFLAGS+= -fopenmp
+QMAKE_LFLAGS +=  -fopenmp
+
+SOURCES += \
+    cli.cpp \
+    colourcache.cpp \
+    colourlut.cpp \
+    fixednetwork.cpp \
+    imageapply.cpp \
+    imagepyramid.cpp \
+    imagestream.cpp \
+    mappingfile.cpp \
+    modelfile.cpp \
+    network.cpp \
+    pixelkernel.cpp \
+    runthread.cpp \
+    trainer.cpp
+
+HEADERS += \
+    colourcache.h \
+    colourlut.h \
+    fixednetwork.h \
+    imageapply.h \
+    imagepyramid.h \
+    imagestream.h \
+    mappingfile.h \
+    modelfile.h \
+    network.h \
+    pixelkernel.h \
+    pixeltransform.h \
+    runsettings.h \
+    runthread.h \
+    telemetry.h \
+    trainer.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,21 @@
+QT       += core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = qtmixer-test
+
+QMAKE_CXXFLAGS+= -fopenmp
+QMAKE_LFLAGS +=  -fopenmp
+
+SOURCES += \
+    colourcache.cpp \
+    imageapply.cpp \
+    imagestream.cpp \
+    test.cpp
+
+HEADERS += \
+    colourcache.h \
+    imageapply.h \
+    imagestream.h \
+    pixeltransform.h
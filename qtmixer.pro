@@ -12,25 +12,56 @@ QMAKE_LFLAGS +=  -fopenmp
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    colourcache.cpp \
+    colourlut.cpp \
     colourpanel.cpp \
+    errorhistory.cpp \
+    fixednetwork.cpp \
+    imageapply.cpp \
+    imageloader.cpp \
+    imagepyramid.cpp \
+    imageview.cpp \
     main.cpp \
     mainwindow.cpp \
+    modelfile.cpp \
+    network.cpp \
     outputwindow.cpp \
+    pixelkernel.cpp \
+    previewpanel.cpp \
+    previewworker.cpp \
     runpanel.cpp \
-    runthread.cpp
+    runthread.cpp \
+    trainer.cpp
 
 HEADERS += \
+    colourcache.h \
+    colourlut.h \
     colourpanel.h \
-    graph.h \
+    errorhistory.h \
+    fixednetwork.h \
+    imageapply.h \
+    imageloader.h \
+    imagepyramid.h \
+    imageview.h \
     mainwindow.h \
+    modelfile.h \
+    network.h \
     outputwindow.h \
+    pixelkernel.h \
+    pixeltransform.h \
+    previewpanel.h \
+    previewworker.h \
     runpanel.h \
-    runthread.h
+    runsettings.h \
+    runthread.h \
+    telemetry.h \
+    trainer.h
 
 FORMS += \
     colourpanel.ui \
     mainwindow.ui \
     outputwindow.ui \
+    previewpanel.ui \
     runpanel.ui
 
 # Default rules for deployment.
@@ -1,12 +1,17 @@
 #include "runpanel.h"
 #include "ui_runpanel.h"
 #include <sstream>
+#include <chrono>
+#include <limits>
 #include <QPainter>
 #include <QImage>
+#include <QRegularExpressionValidator>
 
 RunPanel::RunPanel(QWidget *parent) :
     QDockWidget(parent),
-    ui(new Ui::RunPanel)
+    ui(new Ui::RunPanel),
+    rate_iteration_(0),
+    iterations_per_second_(0)
 {
     QWidget* container = new QWidget(this);
     ui->setupUi(container);
@@ -14,6 +19,9 @@ RunPanel::RunPanel(QWidget *parent) :
 
     connect(ui->runButton, &QPushButton::clicked, this, &RunPanel::runButtonClick);
     connect(ui->stopButton, &QPushButton::clicked, this, &RunPanel::stopButtonClick);
+    connect(ui->zoom, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &RunPanel::drawGraph);
+
+    ui->layers->setValidator(new QRegularExpressionValidator(QRegularExpression("^\\s*[1-9][0-9]*(\\s*,\\s*[1-9][0-9]*)*\\s*$"), this));
 
     setState(RunEnabled);
 
@@ -29,10 +37,34 @@ RunPanel::~RunPanel()
 void RunPanel::setState(const States state) {
     if (state == RunEnabled) {
         ui->rate->setEnabled(true);
+        ui->optimizer->setEnabled(true);
+        ui->plateau->setEnabled(true);
+        ui->minGradient->setEnabled(true);
+        ui->timeBudget->setEnabled(true);
+        ui->layers->setEnabled(true);
+        ui->batch->setEnabled(true);
+        ui->bestOnAll->setEnabled(true);
+        ui->starts->setEnabled(true);
+        ui->warmStart->setEnabled(true);
+        ui->lutSize->setEnabled(true);
+        ui->lutInterpolation->setEnabled(true);
+        ui->cacheColours->setEnabled(true);
         ui->runButton->setEnabled(true);
         ui->stopButton->setEnabled(false);
     } else if (state == StopEnabled) {
         ui->rate->setEnabled(false);
+        ui->optimizer->setEnabled(false);
+        ui->plateau->setEnabled(false);
+        ui->minGradient->setEnabled(false);
+        ui->timeBudget->setEnabled(false);
+        ui->layers->setEnabled(false);
+        ui->batch->setEnabled(false);
+        ui->bestOnAll->setEnabled(false);
+        ui->starts->setEnabled(false);
+        ui->warmStart->setEnabled(false);
+        ui->lutSize->setEnabled(false);
+        ui->lutInterpolation->setEnabled(false);
+        ui->cacheColours->setEnabled(false);
         ui->runButton->setEnabled(false);
         ui->stopButton->setEnabled(true);
     } else if (state == StopDisabled) {
@@ -40,18 +72,47 @@ void RunPanel::setState(const States state) {
     }
 }
 
-void RunPanel::setError(const double error, const double best_error) {
-    if (best_errors_.empty() || (best_error < errors_[best_errors_.back()])) {
-        best_errors_.push_back(errors_.size());
-        errors_.push_back(best_error);
+void RunPanel::addSamples(const std::vector<training_sample>& samples) {
+    if (samples.empty()) {
+        return;
+    }
+
+    for (const training_sample& sample : samples) {
+        error_bin run;
+        run.count = sample.steps;
+        run.first = sample.first_error;
+        run.last = sample.error;
+        run.min = sample.min_error;
+        run.max = sample.max_error;
+        history_.push(run);
     }
 
-    errors_.push_back(error);
+    /* Rate over the samples received since the previous update */
+    const auto now = std::chrono::steady_clock::now();
+    const training_sample& last = samples.back();
+    if (rate_iteration_ != 0) {
+        const std::chrono::duration<double> elapsed = now - rate_time_;
+        if (elapsed.count() > 0) {
+            iterations_per_second_ = (last.iteration - rate_iteration_) / elapsed.count();
+        }
+    }
+    rate_time_ = now;
+    rate_iteration_ = last.iteration;
 
     std::stringstream ss;
-    ss << "Best: " << errors_[best_errors_.back()] << ", Last: " << errors_.back() << std::endl;
+    ss << "Best: " << history_.best() << ", Last: " << last.error << std::endl;
+    ss << "Iterations: " << last.iteration << " (" << size_t(iterations_per_second_) << "/s)" << std::endl;
+    ss << "Gradient norm: " << last.gradient_norm;
     ui->error->setText(ss.str().c_str());
 
+    drawGraph();
+}
+
+void RunPanel::drawGraph() {
+    if (history_.size() == 0) {
+        return;
+    }
+
     QPixmap image(300, 100);
     QPainter painter(&image);
 
@@ -60,36 +121,55 @@ void RunPanel::setError(const double error, const double best_error) {
 
     painter.fillRect(0, 0, image.width(), image.height(), Qt::white);
 
+    /* One bin per pixel column at most, so drawing cost does not depend on
+     * how long the run has been going */
+    const uint64_t spans[] = { 0, 1000, 10000, 100000, 1000000 };
+    history_.query(spans[ui->zoom->currentIndex()], size_t(width + 1), bins_);
+
     double max_error = -std::numeric_limits<double>::max();
     double min_error = std::numeric_limits<double>::max();
+    uint64_t total = 0;
 
-    for (size_t i = 0; i < errors_.size(); ++i) {
-        max_error = std::max(max_error, errors_[i]);
-        min_error = std::min(min_error, errors_[i]);
+    for (const error_bin& bin : bins_) {
+        max_error = std::max(max_error, bin.max);
+        min_error = std::min(min_error, bin.min);
+        total += bin.count;
     }
 
-    double scale = 0.8;
+    const double scale = 0.8;
+    const double range = max_error > min_error ? max_error - min_error : 1.0;
+
+    auto y = [&](const double error) {
+        const double v = (error - min_error) / range;
+        return int(height - ((v - 0.5) * scale + 0.5) * height);
+    };
+
+    /* Each bin is drawn at the position of its last sample */
+    std::vector<int> x(bins_.size());
+    uint64_t end = 0;
+    for (size_t i = 0; i < bins_.size(); ++i) {
+        end += bins_[i].count;
+        x[i] = total > 1 ? int((end - 1) / double(total - 1) * width) : 0;
+    }
 
     painter.setPen(Qt::black);
-    for (size_t i = 1; i < errors_.size(); ++i) {
-        double x_begin = (i - 1) / double(errors_.size() - 1) * width;
-        double y_begin = (errors_[i - 1] - min_error) / (max_error - min_error);
-        y_begin = ((y_begin - 0.5) * scale + 0.5) * height;
-        double x_end = i / double(errors_.size() - 1) * width;
-        double y_end = (errors_[i] - min_error) / (max_error - min_error);
-        y_end = ((y_end - 0.5) * scale + 0.5) * height;
-        painter.drawLine(int(x_begin), int(height - y_begin), int(x_end), int(height - y_end));
+    for (size_t i = 0; i < bins_.size(); ++i) {
+        if (bins_[i].min != bins_[i].max) {
+            painter.drawLine(x[i], y(bins_[i].min), x[i], y(bins_[i].max));
+        }
+        if (i > 0) {
+            painter.drawLine(x[i - 1], y(bins_[i - 1].last), x[i], y(bins_[i].first));
+        }
     }
 
+    /* The best error so far is a falling staircase */
     painter.setPen(Qt::red);
-    for (size_t i = 1; i < best_errors_.size(); ++i) {
-        double x_begin = (best_errors_[i] - 1) / double(errors_.size() - 1) * width;
-        double y_begin = (errors_[best_errors_[i - 1]] - min_error) / (max_error - min_error);
-        y_begin = ((y_begin - 0.5) * scale + 0.5) * height;
-        double x_end = best_errors_[i] / double(errors_.size() - 1) * width;
-        double y_end = (errors_[best_errors_[i]] - min_error) / (max_error - min_error);
-        y_end = ((y_end - 0.5) * scale + 0.5) * height;
-        painter.drawLine(int(x_begin), int(height - y_begin), int(x_end), int(height - y_end));
+    for (size_t i = 1; i < bins_.size(); ++i) {
+        const int best = y(bins_[i - 1].best);
+        painter.drawLine(x[i - 1], best, x[i], best);
+        if (bins_[i].best != bins_[i - 1].best) {
+            painter.drawLine(x[i], best, x[i], y(bins_[i].best));
+        }
     }
 
     ui->graph->setPixmap(image);
@@ -97,15 +177,46 @@ void RunPanel::setError(const double error, const double best_error) {
 }
 
 void RunPanel::resetGraph() {
-    errors_.clear();
-    best_errors_.clear();
+    history_.clear();
+    rate_iteration_ = 0;
+    iterations_per_second_ = 0;
 }
 
 void RunPanel::runButtonClick() {
-    ui->rate->setEnabled(false);
-    emit runBegin(ui->rate->value());
+    setState(StopEnabled);
+    run_settings settings;
+    settings.learning_rate = ui->rate->value();
+    const optimizer_type optimizers[] = { optimizer_type::sgd, optimizer_type::momentum, optimizer_type::rmsprop, optimizer_type::adam };
+    settings.optimizer = optimizers[ui->optimizer->currentIndex()];
+    settings.plateau_iterations = size_t(ui->plateau->value());
+    settings.min_gradient_norm = ui->minGradient->value();
+    settings.time_budget = ui->timeBudget->value();
+    settings.hidden_layers = hiddenLayers();
+    settings.batch_size = size_t(ui->batch->value());
+    settings.best_on_all = ui->bestOnAll->isChecked();
+    settings.starts = size_t(ui->starts->value());
+    settings.warm_start = ui->warmStart->isChecked();
+    const size_t lutSizes[] = { 0, 17, 33, 65 };
+    settings.lut_size = lutSizes[ui->lutSize->currentIndex()];
+    settings.lut_tetrahedral = ui->lutInterpolation->currentIndex() == 1;
+    settings.cache_colours = ui->cacheColours->isChecked();
+    emit runBegin(settings);
 }
 
 void RunPanel::stopButtonClick() {
     emit runEnd();
 }
+
+std::vector<size_t> RunPanel::hiddenLayers() const {
+    std::vector<size_t> widths;
+    for (const QString& item : ui->layers->text().split(',', Qt::SkipEmptyParts)) {
+        const int width = item.trimmed().toInt();
+        if (width > 0) {
+            widths.push_back(size_t(width));
+        }
+    }
+    if (widths.empty()) {
+        widths.push_back(4);
+    }
+    return widths;
+}
@@ -1,8 +1,11 @@
 #ifndef RUNPANEL_H
 #define RUNPANEL_H
 
+#include "runsettings.h"
+#include "telemetry.h"
+#include "errorhistory.h"
 #include <QDockWidget>
-#include <deque>
+#include <chrono>
 
 namespace Ui {
 class RunPanel;
@@ -24,21 +27,30 @@ public:
 
     void setState(const States state);
 
-    void setError(const double error, const double best_error);
+    /* Adds training telemetry to the error graph and updates the
+     * iteration rate shown beneath it. */
+    void addSamples(const std::vector<training_sample>& samples);
 
     void resetGraph();
 
 signals:
-    void runBegin(const double learningRate);
+    void runBegin(const run_settings& settings);
     void runEnd();
 
 private:
     void runButtonClick();
     void stopButtonClick();
 
+    std::vector<size_t> hiddenLayers() const;
+
+    void drawGraph();
+
     Ui::RunPanel *ui;
-    std::deque<double> errors_;
-    std::deque<double> best_errors_;
+    error_history history_;
+    std::vector<error_bin> bins_;
+    std::chrono::steady_clock::time_point rate_time_;
+    uint64_t rate_iteration_;
+    double iterations_per_second_;
 };
 
 #endif // RUNPANEL_H
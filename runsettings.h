@@ -0,0 +1,33 @@
+#ifndef __RUN_SETTINGS_H__
+#define __RUN_SETTINGS_H__
+
+#include "trainer.h"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/* Options chosen in the RunPanel for a single training run. */
+struct run_settings {
+    run_settings() : learning_rate(0.01), hidden_layers(1, 4), batch_size(1), max_iterations(0), lut_size(0), lut_tetrahedral(false), cache_colours(true), best_on_all(true), optimizer(optimizer_type::sgd), plateau_iterations(0), plateau_tolerance(1e-3), min_gradient_norm(0), time_budget(0), starts(1), seed(1), warm_start(false), result_pyramid(false) {
+    }
+
+    double learning_rate;
+    std::vector<size_t> hidden_layers; /* width of each hidden layer */
+    size_t batch_size; /* colour mappings per step, 0 for all of them */
+    size_t max_iterations; /* training steps before applying, 0 to run until stopped */
+    size_t lut_size; /* entries per axis of the baked 3D LUT, 0 to apply the network directly */
+    bool lut_tetrahedral; /* tetrahedral rather than trilinear LUT interpolation */
+    bool cache_colours; /* evaluate once per distinct colour when that is cheaper */
+    bool best_on_all; /* judge the best parameters on every mapping once per pass, not on each batch */
+    optimizer_type optimizer;
+    size_t plateau_iterations; /* stop after this many steps without progress, 0 to never */
+    double plateau_tolerance; /* relative fall in the smoothed error that counts as progress */
+    double min_gradient_norm; /* stop once the smoothed gradient norm is below this, 0 to never */
+    double time_budget; /* seconds of training before applying, 0 for no limit */
+    size_t starts; /* differently initialised networks raced against each other */
+    uint32_t seed; /* seeds the initial weights of every start */
+    bool warm_start; /* continue from the previous run's parameters when the network matches */
+    bool result_pyramid; /* also halve the result into an image_pyramid for viewing */
+};
+
+#endif /* __RUN_SETTINGS_H__ */
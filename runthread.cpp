@@ -1,5 +1,52 @@
 #include "runthread.h"
-#include <sstream>
+#include "trainer.h"
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace {
+
+/* Steps each start trains for between culls when racing several starts */
+const size_t race_round = 1000;
+
+/* One independently initialised network and the state of its training */
+struct training_instance {
+    training_instance(const std::vector<size_t>& widths, const std::vector<double>& inputs, const std::vector<double>& targets, const run_settings& settings, const size_t index, const training_state* initial) :
+        network(widths),
+        trainer(network, inputs, targets, settings.batch_size, settings.optimizer),
+        steps_per_pass((trainer.num_samples() + trainer.batch_size() - 1) / trainer.batch_size()),
+        /* Smoothed over roughly one pass through the mappings */
+        monitor(settings.plateau_iterations, settings.plateau_tolerance, settings.min_gradient_norm, 1.0 / steps_per_pass),
+        iteration(0),
+        score(std::numeric_limits<double>::max()),
+        best_error(std::numeric_limits<double>::max()) {
+        /* Each start draws from its own stream, so a run is reproducible
+         * whatever order the starts are trained in */
+        std::seed_seq seed{ settings.seed, uint32_t(index) };
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> weight(-1, 1);
+        for (double& parameter : network.parameters()) {
+            parameter = weight(rng);
+        }
+        if (initial) {
+            network.parameters() = initial->parameters;
+            trainer.restore(initial->optimizer);
+        }
+        best_parameters = network.parameters();
+    }
+
+    dense_network network;
+    network_trainer trainer;
+    size_t steps_per_pass;
+    convergence_monitor monitor;
+    size_t iteration;
+    double score; /* error over every mapping at the end of the last round */
+    double best_error;
+    std::vector<double> best_parameters;
+    std::vector<std::pair<double, double>> samples; /* error and gradient norm of each step in the last round */
+};
+
+}
 
 run_thread::~run_thread() {
     run_ = false;
@@ -7,147 +54,262 @@ run_thread::~run_thread() {
     thread_->join();
 }
 
-run_thread::run_thread(const QImage& image, const std::vector<std::pair<QColor, QColor>>& cmap, const double learning_rate) : image_(image), cmap_(cmap), learning_rate_(learning_rate) {
+run_thread::run_thread(const QImage& image, const std::vector<std::pair<QColor, QColor>>& cmap, const run_settings& settings, std::shared_ptr<const training_state> initial) : image_(image), cmap_(cmap), settings_(settings), warm_started_(false), telemetry_(1 << 16) {
     done_ = false;
     run_ = true;
     abort_ = false;
+    pixels_per_second_ = 0;
+    best_version_ = 0;
+    widths_.push_back(3);
+    widths_.insert(std::end(widths_), std::begin(settings_.hidden_layers), std::end(settings_.hidden_layers));
+    widths_.push_back(3);
+    if (settings_.warm_start && initial && initial->widths == widths_) {
+        initial_ = initial;
+        warm_started_ = true;
+    }
     thread_ = std::make_shared<std::thread>(std::bind(&run_thread::thread_function, this));
 }
 
-void run_thread::thread_function() {
+void run_thread::publish_best(const std::vector<double>& parameters) {
+    std::lock_guard<std::mutex> lock(best_mutex_);
+    published_parameters_ = parameters;
+    best_version_++;
+}
+
+QImage run_thread::apply(const pixel_transform& transform) {
+    QImage new_image = prepare_image(image_);
 
-    graph_evaluator bp;
+    const auto start = std::chrono::steady_clock::now();
 
-    std::vector<graph_builder> input(3);
-    for (size_t i = 0; i < input.size(); ++i) {
-      input[i] = bp.parameter();
+    if (!settings_.cache_colours || !apply_cached(transform, new_image, abort_)) {
+        apply_direct(transform, new_image, abort_);
     }
 
-    bp_layer layer1(bp, input, 4, false);
-    bp_layer output_layer(bp, layer1.outputs_, 3, true);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed.count() > 0) {
+        pixels_per_second_ = double(new_image.width()) * double(new_image.height()) / elapsed.count();
+    }
+
+    return new_image;
+}
 
-    std::vector<graph_builder> all_params;
-    all_params.insert(std::end(all_params), std::begin(layer1.parameters_), std::end(layer1.parameters_));
-    all_params.insert(std::end(all_params), std::begin(output_layer.parameters_), std::end(output_layer.parameters_));
+void run_thread::thread_function() {
 
-    for (size_t i = 0; i < all_params.size(); ++i) {
-      bp.set_parameter(all_params[i], (rand() / double(RAND_MAX) * 2 - 1));
+    std::vector<double> inputs;
+    std::vector<double> targets;
+    for (const auto& mapping : cmap_) {
+      inputs.push_back(mapping.first.redF());
+      inputs.push_back(mapping.first.greenF());
+      inputs.push_back(mapping.first.blueF());
+      targets.push_back(mapping.second.redF());
+      targets.push_back(mapping.second.greenF());
+      targets.push_back(mapping.second.blueF());
     }
 
-    graph_builder error;
-    std::vector<graph_builder> cmatch(3);
-    for (size_t i = 0; i < cmatch.size(); ++i) {
-      cmatch[i] = bp.parameter();
-      graph_builder e = output_layer.outputs_[i] - cmatch[i];
-      e = e * e;
-      if (error.empty()) {
-          error = e;
-      } else {
-          error = error + e;
-      }
+    const double lr = settings_.learning_rate;
+    const auto train_start = std::chrono::steady_clock::now();
+    stop_reason_ = "stopped";
+    best_error_ = std::numeric_limits<double>::max();
+
+    /* Fast steps are sent in batches so the ring keeps up with them */
+    sample_aggregator aggregator;
+
+    std::vector<std::unique_ptr<training_instance>> instances;
+    for (size_t i = 0; i < std::max<size_t>(settings_.starts, 1); ++i) {
+        /* A warm start takes the place of the first random one, so it has
+         * to beat the others to survive the race */
+        instances.emplace_back(new training_instance(widths_, inputs, targets, settings_, i, i == 0 ? initial_.get() : nullptr));
     }
 
-    const double lr = learning_rate_;
+    const size_t steps_per_pass = instances.front()->steps_per_pass;
 
-    graph_evaluator best_bp;
-    best_error_ = std::numeric_limits<double>::max();
+    /* Race the starts: every round each survivor trains for the same number
+     * of steps, all of them scored on every mapping, and the worse half is
+     * dropped until one remains */
+    size_t round_steps = std::max(race_round, steps_per_pass);
+    if (settings_.max_iterations != 0) {
+        size_t culls = 0;
+        while ((size_t(1) << culls) < instances.size()) {
+            culls++;
+        }
+        round_steps = std::max<size_t>(1, std::min(round_steps, settings_.max_iterations / (2 * std::max<size_t>(culls, 1))));
+    }
 
-    size_t iteration = 0;
-    while (run_ == true && abort_ == false) {
-      iteration++;
-      QColor col_in = cmap_[iteration % cmap_.size()].first;
-      QColor col_out = cmap_[iteration % cmap_.size()].second;
+    while (instances.size() > 1 && run_ == true && abort_ == false) {
+        if (settings_.time_budget > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - train_start).count() >= settings_.time_budget) {
+            break;
+        }
 
-      bp.set_parameter(input[0], col_in.redF());
-      bp.set_parameter(input[1], col_in.greenF());
-      bp.set_parameter(input[2], col_in.blueF());
+        const auto round_start = std::chrono::steady_clock::now();
 
-      bp.set_parameter(cmatch[0], col_out.redF());
-      bp.set_parameter(cmatch[1], col_out.greenF());
-      bp.set_parameter(cmatch[2], col_out.blueF());
+        #pragma omp parallel for schedule(dynamic, 1)
+        for (long i = 0; i < long(instances.size()); ++i) {
+            training_instance& instance = *instances[size_t(i)];
+            instance.samples.clear();
+            for (size_t step = 0; step < round_steps && run_ == true && abort_ == false; ++step) {
+                const double e = instance.trainer.compute_gradient();
+                instance.trainer.update(lr, e);
+                instance.iteration++;
 
-      double e = bp.evaluate(error);
-      error_ = e;
+                const double gradient_norm = instance.trainer.gradient_norm();
+                instance.samples.push_back(std::make_pair(e, gradient_norm));
+                instance.monitor.update(e, gradient_norm);
+            }
+            instance.score = instance.trainer.evaluate();
+            if (instance.score < instance.best_error) {
+                instance.best_error = instance.score;
+                instance.best_parameters = instance.network.parameters();
+            }
+        }
 
-      if (e < best_error_) {
-          best_bp = bp;
-          best_error_ = e;
-      }
+        std::sort(std::begin(instances), std::end(instances), [](const std::unique_ptr<training_instance>& a, const std::unique_ptr<training_instance>& b) {
+            return a->score < b->score;
+        });
 
-      std::vector<double> deltas(all_params.size());
-      #pragma parallel for
-      for (size_t j = 0; j < all_params.size(); ++j) {
-          deltas[j] = bp.evaluate_delta(error, all_params[j]);
+        /* The curve follows whichever start is leading */
+        const training_instance& leader = *instances.front();
+        const std::chrono::duration<double> round_time = std::chrono::steady_clock::now() - round_start;
+        const uint64_t first_iteration = leader.iteration - leader.samples.size();
+        for (size_t step = 0; step < leader.samples.size(); ++step) {
+            if (aggregator.add(first_iteration + step + 1, leader.samples[step].first, leader.samples[step].second, round_time.count() / leader.samples.size())) {
+                telemetry_.push(aggregator.sample());
+                aggregator.reset();
+            }
+        }
+        if (!leader.samples.empty()) {
+            error_ = leader.samples.back().first;
+        }
+        best_error_ = leader.best_error;
+        publish_best(leader.best_parameters);
+
+        instances.resize((instances.size() + 1) / 2);
+    }
+
+    training_instance& survivor = *instances.front();
+    dense_network& network = survivor.network;
+    network_trainer& trainer = survivor.trainer;
+    convergence_monitor& monitor = survivor.monitor;
+    std::vector<double>& parameters = network.parameters();
+    std::vector<double>& best_parameters = survivor.best_parameters;
+    size_t& iteration = survivor.iteration;
+    best_error_ = survivor.best_error;
+
+    const bool judge_all = settings_.best_on_all && trainer.batch_size() < trainer.num_samples();
+
+    /* Publishing takes a lock and a copy, so it is rate limited */
+    const std::chrono::milliseconds publish_interval(100);
+    auto last_publish = std::chrono::steady_clock::now();
+    bool unpublished = false;
+
+    /* Each step ends where the next starts, so it takes one clock read */
+    auto step_start = std::chrono::steady_clock::now();
+
+    while (run_ == true && abort_ == false) {
+      if (settings_.max_iterations != 0 && iteration >= settings_.max_iterations) {
+          stop_reason_ = "iteration limit";
+          break;
       }
 
-      for (size_t j = 0; j < all_params.size(); ++j) {
-          double c = bp.get_parameter(all_params[j]);
-          bp.set_parameter(all_params[j], c - deltas[j] * e * lr);
+      if (settings_.time_budget > 0 && std::chrono::duration<double>(step_start - train_start).count() >= settings_.time_budget) {
+          stop_reason_ = "time budget";
+          break;
       }
-    }
+      iteration++;
 
-    bp = best_bp;
+      double e = trainer.compute_gradient();
+      error_ = e;
 
-    QImage new_image = image_;
-    #pragma parallel for
-    for (int y = 0; y < new_image.height(); ++y) {
-        graph_evaluator omp_bp = bp;
-        for (int x = 0; x < new_image.width(); ++x) {
-          if (abort_ == true) {
-            break;
-          }
+      /* A single batch's error is a noisy measure of the model, so unless
+       * every mapping is in the batch the candidate is scored over all of
+       * them once per pass instead */
+      const bool check = !judge_all || (iteration - 1) % steps_per_pass == 0;
+      const double score = judge_all ? (check ? trainer.evaluate() : 0) : e;
+      if (check && score < best_error_) {
+          std::copy(std::begin(parameters), std::end(parameters), std::begin(best_parameters));
+          best_error_ = score;
+          unpublished = true;
+      }
 
-          QColor current = new_image.pixel(x, y);
-          omp_bp.set_parameter(input[0], current.redF());
-          omp_bp.set_parameter(input[1], current.greenF());
-          omp_bp.set_parameter(input[2], current.blueF());
+      trainer.update(lr, e);
 
-          omp_bp.evaluate(error);
+      const auto step_end = std::chrono::steady_clock::now();
+      const std::chrono::duration<double> step_time = step_end - step_start;
+      step_start = step_end;
+      const double gradient_norm = trainer.gradient_norm();
+      if (aggregator.add(iteration, e, gradient_norm, step_time.count())) {
+          telemetry_.push(aggregator.sample());
+          aggregator.reset();
+      }
 
-          QColor new_colour;
-          new_colour.setRedF(omp_bp.get_parameter(output_layer.outputs_[0]));
-          new_colour.setGreenF(omp_bp.get_parameter(output_layer.outputs_[1]));
-          new_colour.setBlueF(omp_bp.get_parameter(output_layer.outputs_[2]));
+      const convergence_monitor::reason converged = monitor.update(e, gradient_norm);
+      if (converged != convergence_monitor::running) {
+          stop_reason_ = converged == convergence_monitor::plateau ? "error plateau" : "small gradient";
+          break;
+      }
 
-          new_image.setPixel(x, y, new_colour.rgb());
-        }
+      if (unpublished && (iteration % 256) == 0) {
+          const auto now = std::chrono::steady_clock::now();
+          if (now - last_publish >= publish_interval) {
+              publish_best(best_parameters);
+              last_publish = now;
+              unpublished = false;
+          }
+      }
     }
 
-    std::stringstream ss;
-    ss << "mat4x4 a = mat4x4(";
-    for (size_t i = 0; i < 4; ++i) {
-        for (size_t j = 0; j < 4; ++j) {
-            if (i != 0 || j != 0) {
-                ss << ", ";
-            }
-            ss << bp.get_parameter(layer1.parameters_[j * 4 + i]);
-        }
+    if (!aggregator.empty()) {
+        telemetry_.push(aggregator.sample());
     }
-    ss << ");" << std::endl;
 
-    ss << "mat4x3 b = mat4x3(";
-    for (size_t i = 0; i < 4; ++i) {
-        for (size_t j = 0; j < 3; ++j) {
-            if (i != 0 || j != 0) {
-                ss << ", ";
-            }
-            ss << bp.get_parameter(output_layer.parameters_[j * 5 + i]);
+    if (judge_all && iteration > 0) {
+        const double score = trainer.evaluate();
+        if (score < best_error_) {
+            best_error_ = score;
+            best_parameters = parameters;
         }
     }
-    ss << ");" << std::endl;
 
-    ss << "vec3 c = vec3(";
-    for (size_t i = 0; i < 3; ++i) {
-        if (i != 0) {
-            ss << ", ";
-        }
-        ss << bp.get_parameter(output_layer.parameters_[i * 5 + 4]);
+    parameters = best_parameters;
+    publish_best(best_parameters);
+
+    /* The next run continues from what was applied, with the optimizer
+     * state as it was at the last step */
+    std::shared_ptr<training_state> state = std::make_shared<training_state>();
+    state->widths = widths_;
+    state->parameters = best_parameters;
+    state->optimizer = trainer.state();
+    state_ = state;
+
+    model_.widths = widths_;
+    model_.parameters.assign(std::begin(parameters), std::end(parameters));
+    model_.cmap = cmap_;
+    model_.optimizer = settings_.optimizer;
+    model_.learning_rate = lr;
+    model_.batch_size = trainer.batch_size();
+    model_.iterations = iteration;
+    model_.best_error = best_error_;
+    model_.lut_size = settings_.lut_size;
+    model_.lut_tetrahedral = settings_.lut_tetrahedral;
+
+    std::shared_ptr<pixel_kernel> kernel = std::make_shared<pixel_kernel>(widths_, model_.parameters);
+    transform_ = kernel;
+
+    if (settings_.lut_size > 0) {
+        std::shared_ptr<colour_lut> lut = std::make_shared<colour_lut>(*kernel, settings_.lut_size, settings_.lut_tetrahedral ? colour_lut::tetrahedral : colour_lut::trilinear);
+        result_cube_ = lut->cube("qtmixer");
+        transform_ = lut;
+    }
+
+    QImage new_image;
+    if (!image_.isNull()) {
+        new_image = apply(*transform_);
     }
-    ss << ");" << std::endl;
 
-    ss << "col = b * tanh(a * vec4(col, 1.0)) + c;";
+    result_string_ = network.glsl();
 
-    result_string_ = ss.str();
+    if (settings_.result_pyramid && !new_image.isNull()) {
+        result_pyramid_ = image_pyramid(new_image);
+    }
 
     result_ = new_image;
     done_ = true;
@@ -1,20 +1,38 @@
 #ifndef __RUN_THREAD_H__
 #define __RUN_THREAD_H__
 
-#include "graph.h"
+#include "network.h"
+#include "pixelkernel.h"
+#include "colourlut.h"
+#include "imageapply.h"
+#include "runsettings.h"
+#include "telemetry.h"
+#include "modelfile.h"
+#include "imagepyramid.h"
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <QImage>
 #include <QColor>
 #include <vector>
 
+/* What a finished run leaves behind for the next one to continue from. */
+struct training_state {
+    std::vector<size_t> widths;
+    std::vector<double> parameters;
+    optimizer_state optimizer;
+};
+
 class run_thread {
 public:
 
     ~run_thread();
 
-    run_thread(const QImage& image, const std::vector<std::pair<QColor, QColor>>& cmap, const double learning_rate);
+    /* When settings.warm_start is set and initial was saved from a network
+     * of the same widths, the first start continues from it instead of
+     * from random weights. */
+    run_thread(const QImage& image, const std::vector<std::pair<QColor, QColor>>& cmap, const run_settings& settings, std::shared_ptr<const training_state> initial = nullptr);
 
     void stop() {
         run_ = false;
@@ -24,10 +42,25 @@ public:
         return result_;
     }
 
+    /* The result halved for viewing, built on this thread when
+     * settings.result_pyramid is set; valid once done */
+    const image_pyramid& result_pyramid() const {
+        return result_pyramid_;
+    }
+
     std::string result_string() const {
         return result_string_;
     }
 
+    std::string result_cube() const {
+        return result_cube_;
+    }
+
+    /* The trained mapping, as applied to the image; valid once done */
+    std::shared_ptr<const pixel_transform> result_transform() const {
+        return transform_;
+    }
+
     bool is_running() const {
         return run_;
     }
@@ -44,17 +77,91 @@ public:
         return best_error_;
     }
 
+    /* Why training ended; valid once done */
+    std::string get_stop_reason() const {
+        return stop_reason_;
+    }
+
+    double get_pixels_per_second() const {
+        return pixels_per_second_;
+    }
+
+    /* Appends the records of training steps made since the last call to
+     * samples and returns how many were added. Only one thread may drain
+     * the telemetry. */
+    size_t take_telemetry(std::vector<training_sample>& samples) {
+        return telemetry_.pop(samples);
+    }
+
+    /* Records lost because telemetry was not drained quickly enough */
+    size_t get_dropped_telemetry() const {
+        return telemetry_.dropped();
+    }
+
+    /* The applied parameters and the optimizer state, for warm starting
+     * the next run; valid once done */
+    std::shared_ptr<const training_state> result_state() const {
+        return state_;
+    }
+
+    /* The trained network with its mappings and settings, for saving as a
+     * model file; valid once done */
+    const model_data& result_model() const {
+        return model_;
+    }
+
+    /* Whether this run continued from an earlier one */
+    bool is_warm_started() const {
+        return warm_started_;
+    }
+
+    /* Layer widths of the network being trained */
+    const std::vector<size_t>& widths() const {
+        return widths_;
+    }
+
+    /* Incremented whenever a better set of parameters is published */
+    size_t get_best_version() const {
+        return best_version_;
+    }
+
+    /* The best parameters published so far, for previewing mid-run */
+    std::vector<double> get_best_parameters() const {
+        std::lock_guard<std::mutex> lock(best_mutex_);
+        return published_parameters_;
+    }
+
 private:
 
     void thread_function();
 
+    void publish_best(const std::vector<double>& parameters);
+
+    QImage apply(const pixel_transform& transform);
+
     QImage image_;
     QImage result_;
+    image_pyramid result_pyramid_;
     std::string result_string_;
+    std::string result_cube_;
+    std::string stop_reason_;
+    std::shared_ptr<const pixel_transform> transform_;
     std::vector<std::pair<QColor, QColor>> cmap_;
-    double learning_rate_;
+    run_settings settings_;
+    std::vector<size_t> widths_;
+    std::shared_ptr<const training_state> initial_;
+    std::shared_ptr<const training_state> state_;
+    model_data model_;
+    bool warm_started_;
+    /* Records arrive at most every 50us, so this covers three seconds
+     * between drains */
+    spsc_ring<training_sample> telemetry_;
+    mutable std::mutex best_mutex_;
+    std::vector<double> published_parameters_;
+    std::atomic<size_t> best_version_;
     std::atomic<double> error_;
     std::atomic<double> best_error_;
+    std::atomic<double> pixels_per_second_;
     std::atomic<bool> run_;
     std::atomic<bool> abort_;
     std::atomic<bool> done_;
@@ -0,0 +1,131 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/* A run of consecutive training iterations, as recorded by the training
+ * thread. Slow steps get a record each; fast ones are folded together so
+ * the record rate stays bounded (see sample_aggregator). */
+struct training_sample {
+    uint64_t iteration; /* the last step in the run */
+    uint64_t steps; /* steps in the run, at least 1 */
+    double first_error;
+    double error; /* error of the last step */
+    double min_error;
+    double max_error;
+    double gradient_norm; /* Euclidean norm of the last mean gradient */
+    double step_seconds; /* wall time spent on all the steps in the run */
+};
+
+/* Folds training steps into training_sample records.
+ *
+ * A record is complete once its steps have taken at least min_seconds, so
+ * however fast training runs there are at most 1 / min_seconds records a
+ * second and the min, max and last errors of every step are kept. */
+class sample_aggregator {
+public:
+    explicit sample_aggregator(const double min_seconds = 50e-6) : min_seconds_(min_seconds) {
+        sample_.steps = 0;
+    }
+
+    /* Adds one step. Returns true once the record is complete, after
+     * which it should be taken with sample() and reset(). */
+    bool add(const uint64_t iteration, const double error, const double gradient_norm, const double seconds) {
+        if (sample_.steps == 0) {
+            sample_.first_error = error;
+            sample_.min_error = error;
+            sample_.max_error = error;
+            sample_.step_seconds = 0;
+        }
+        sample_.steps++;
+        sample_.iteration = iteration;
+        sample_.error = error;
+        sample_.min_error = std::min(sample_.min_error, error);
+        sample_.max_error = std::max(sample_.max_error, error);
+        sample_.gradient_norm = gradient_norm;
+        sample_.step_seconds += seconds;
+        return sample_.step_seconds >= min_seconds_;
+    }
+
+    bool empty() const {
+        return sample_.steps == 0;
+    }
+
+    const training_sample& sample() const {
+        return sample_;
+    }
+
+    void reset() {
+        sample_.steps = 0;
+    }
+
+private:
+    double min_seconds_;
+    training_sample sample_;
+};
+
+/* Fixed capacity single-producer/single-consumer queue.
+ *
+ * One thread calls push() and one other thread calls pop(); neither ever
+ * blocks. Each side owns one index and only reads the other's, so the only
+ * synchronisation is an acquire/release pair per call. When the consumer
+ * falls behind, push() drops the record and counts it instead of waiting. */
+template <typename T>
+class spsc_ring {
+public:
+    /* capacity is rounded up to a power of two */
+    explicit spsc_ring(const size_t capacity) : head_(0), tail_(0), dropped_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        items_.resize(size);
+        mask_ = size - 1;
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    /* Producer side. Returns false if the queue was full. */
+    bool push(const T& item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) > mask_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side. Appends everything queued so far to out and returns
+     * the number of items taken. */
+    size_t pop(std::vector<T>& out) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; ++i) {
+            out.push_back(items_[i & mask_]);
+        }
+        tail_.store(head, std::memory_order_release);
+        return head - tail;
+    }
+
+    /* Records lost to a full queue since construction */
+    size_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> items_;
+    size_t mask_;
+    /* Kept on separate cache lines so the two threads do not share one */
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+    alignas(64) std::atomic<size_t> dropped_;
+};
+
+#endif /* __TELEMETRY_H__ */
@@ -0,0 +1,94 @@
+#include "imagestream.h"
+#include <QCoreApplication>
+#include <QImage>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const char* const file_name = "qtmixer-test.ppm";
+
+void write_file(const std::string& contents) {
+    std::ofstream file(file_name, std::ios::binary);
+    file << contents;
+}
+
+/* PPM header followed by size bytes of data counting up from zero */
+std::string ppm(const std::string& header, const size_t size) {
+    std::string contents = header;
+    for (size_t i = 0; i < size; ++i) {
+        contents += char(i);
+    }
+    return contents;
+}
+
+size_t failures = 0;
+
+void check(const std::string& name, const bool passed) {
+    std::cerr << (passed ? "pass: " : "FAIL: ") << name << std::endl;
+    failures += !passed;
+}
+
+/* Whether op throws std::runtime_error */
+bool throws(const std::function<void()>& op) {
+    try {
+        op();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void rejects(const std::string& name, const std::string& contents) {
+    write_file(contents);
+    check(name, throws([] { ppm_strip_reader reader(file_name); }));
+}
+
+void test_ppm_strip_reader() {
+    write_file(ppm("P6\n# comment\n2 3\n255\n", 2 * 3 * 3));
+    {
+        ppm_strip_reader reader(file_name);
+        check("ppm size", reader.width() == 2 && reader.height() == 3);
+        const QImage strip = reader.read(1, 2);
+        check("ppm strip", strip.width() == 2 && strip.height() == 2 && strip.pixel(0, 0) == qRgb(6, 7, 8) && strip.pixel(1, 1) == qRgb(15, 16, 17));
+        check("ppm strip past the end", throws([&] { reader.read(2, 2); }));
+        check("ppm strip of no rows", throws([&] { reader.read(0, 0); }));
+        check("ppm strip above the top", throws([&] { reader.read(-1, 1); }));
+    }
+
+    write_file(ppm("P6 1 1 3\n", 3));
+    {
+        ppm_strip_reader reader(file_name);
+        check("ppm maxval scaling", reader.read(0, 1).pixel(0, 0) == qRgb(0, 85, 170));
+    }
+
+    rejects("ppm zero width", ppm("P6 0 3 255\n", 0));
+    rejects("ppm zero height", ppm("P6 2 0 255\n", 0));
+    rejects("ppm negative width", ppm("P6 -2 3 255\n", 18));
+    rejects("ppm non-numeric height", ppm("P6 2 x 255\n", 18));
+    rejects("ppm zero maxval", ppm("P6 2 3 0\n", 18));
+    rejects("ppm 16-bit maxval", ppm("P6 2 3 65535\n", 36));
+    rejects("ppm overlong number", ppm("P6 99999999999 3 255\n", 18));
+    rejects("ppm too wide to stream", ppm("P6 999999999 1 255\n", 18));
+    rejects("ppm height the data cannot hold", ppm("P6 2 999999999 255\n", 18));
+    rejects("ppm truncated data", ppm("P6 2 3 255\n", 17));
+    rejects("ppm missing header fields", "P6 2 3");
+
+    std::remove(file_name);
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    test_ppm_strip_reader();
+
+    std::cerr << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,249 @@
+#include "trainer.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <omp.h>
+
+namespace {
+
+/* Smallest share of a batch worth handing to a thread of its own */
+const size_t min_samples_per_thread = 32;
+
+/* Samples per forward pass when evaluating the whole set */
+const size_t evaluate_chunk = 256;
+
+const double momentum_decay = 0.9;
+const double rms_decay = 0.9;
+const double adam_mean_decay = 0.9;
+const double adam_square_decay = 0.999;
+const double epsilon = 1e-8;
+
+}
+
+network_trainer::network_trainer(dense_network& network, const std::vector<double>& inputs, const std::vector<double>& targets, const size_t batch_size, const optimizer_type optimizer) : network_(network), inputs_(inputs), targets_(targets), next_(0), fixed_(find_fixed_network(network.widths())), optimizer_(optimizer), updates_(0) {
+    num_samples_ = inputs_.size() / network_.num_inputs();
+    if (num_samples_ == 0 || inputs_.size() != num_samples_ * network_.num_inputs() || targets_.size() != num_samples_ * network_.num_outputs()) {
+        throw std::runtime_error("Training samples do not match the network");
+    }
+
+    batch_size_ = (batch_size == 0) ? num_samples_ : batch_size;
+    batch_inputs_.resize(batch_size_ * network_.num_inputs());
+    batch_targets_.resize(batch_size_ * network_.num_outputs());
+
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), batch_size_ / min_samples_per_thread));
+    for (size_t t = 0; t < threads; ++t) {
+        workspaces_.emplace_back(network_, batch_size_);
+        gradients_.emplace_back(network_.num_parameters());
+    }
+    gradient_.resize(network_.num_parameters());
+    if (optimizer_ != optimizer_type::sgd) {
+        first_moment_.resize(network_.num_parameters());
+    }
+    if (optimizer_ == optimizer_type::rmsprop || optimizer_ == optimizer_type::adam) {
+        second_moment_.resize(network_.num_parameters());
+    }
+
+    const size_t chunks = (num_samples_ + evaluate_chunk - 1) / evaluate_chunk;
+    const size_t evaluate_threads = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), chunks));
+    for (size_t t = 0; t < evaluate_threads; ++t) {
+        evaluate_workspaces_.emplace_back(network_, std::min(num_samples_, evaluate_chunk));
+    }
+}
+
+double network_trainer::accumulate(dense_workspace& workspace, const double* inputs, const double* targets, const size_t count, double* gradient) const {
+    if (fixed_) {
+        return fixed_->gradient(network_.parameters().data(), inputs, targets, count, gradient);
+    }
+    network_.forward(workspace, inputs, count);
+    return network_.backward(workspace, targets, count, gradient);
+}
+
+double network_trainer::compute_gradient() {
+    const size_t num_inputs = network_.num_inputs();
+    const size_t num_outputs = network_.num_outputs();
+
+    /* A batch that does not wrap around is read in place */
+    const double* inputs = &inputs_[next_ * num_inputs];
+    const double* targets = &targets_[next_ * num_outputs];
+    if (next_ + batch_size_ > num_samples_) {
+        for (size_t k = 0; k < batch_size_; ++k) {
+            const size_t sample = (next_ + k) % num_samples_;
+            std::copy(&inputs_[sample * num_inputs], &inputs_[sample * num_inputs] + num_inputs, &batch_inputs_[k * num_inputs]);
+            std::copy(&targets_[sample * num_outputs], &targets_[sample * num_outputs] + num_outputs, &batch_targets_[k * num_outputs]);
+        }
+        inputs = batch_inputs_.data();
+        targets = batch_targets_.data();
+    }
+    next_ = (next_ + batch_size_) % num_samples_;
+
+    const int threads = int(workspaces_.size());
+    const long num_parameters = long(gradient_.size());
+    double error = 0;
+
+    if (threads == 1) {
+        std::fill(std::begin(gradient_), std::end(gradient_), 0.0);
+        error = accumulate(workspaces_[0], inputs, targets, batch_size_, gradient_.data());
+        const double scale = 1.0 / batch_size_;
+        for (long j = 0; j < num_parameters; ++j) {
+            gradient_[j] *= scale;
+        }
+        return error * scale;
+    }
+
+    #pragma omp parallel num_threads(threads) reduction(+:error)
+    {
+        const size_t thread = size_t(omp_get_thread_num());
+        const size_t active = size_t(omp_get_num_threads());
+        const size_t begin = batch_size_ * thread / active;
+        const size_t end = batch_size_ * (thread + 1) / active;
+
+        std::vector<double>& gradient = gradients_[thread];
+        std::fill(std::begin(gradient), std::end(gradient), 0.0);
+        if (end > begin) {
+            error += accumulate(workspaces_[thread], inputs + begin * num_inputs, targets + begin * num_outputs, end - begin, gradient.data());
+        }
+
+        #pragma omp barrier
+
+        #pragma omp for
+        for (long j = 0; j < num_parameters; ++j) {
+            double sum = 0;
+            for (size_t t = 0; t < active; ++t) {
+                sum += gradients_[t][j];
+            }
+            gradient_[j] = sum / batch_size_;
+        }
+    }
+
+    return error / batch_size_;
+}
+
+void network_trainer::update(const double learning_rate, const double error) {
+    std::vector<double>& parameters = network_.parameters();
+    const size_t n = parameters.size();
+    updates_++;
+
+    switch (optimizer_) {
+    case optimizer_type::sgd:
+        for (size_t j = 0; j < n; ++j) {
+            parameters[j] -= gradient_[j] * error * learning_rate;
+        }
+        break;
+    case optimizer_type::momentum:
+        for (size_t j = 0; j < n; ++j) {
+            first_moment_[j] = momentum_decay * first_moment_[j] + gradient_[j];
+            parameters[j] -= first_moment_[j] * learning_rate;
+        }
+        break;
+    case optimizer_type::rmsprop:
+        for (size_t j = 0; j < n; ++j) {
+            second_moment_[j] = rms_decay * second_moment_[j] + (1 - rms_decay) * gradient_[j] * gradient_[j];
+            parameters[j] -= gradient_[j] * learning_rate / (std::sqrt(second_moment_[j]) + epsilon);
+        }
+        break;
+    case optimizer_type::adam: {
+        const double mean_correction = 1 / (1 - std::pow(adam_mean_decay, double(updates_)));
+        const double square_correction = 1 / (1 - std::pow(adam_square_decay, double(updates_)));
+        for (size_t j = 0; j < n; ++j) {
+            first_moment_[j] = adam_mean_decay * first_moment_[j] + (1 - adam_mean_decay) * gradient_[j];
+            second_moment_[j] = adam_square_decay * second_moment_[j] + (1 - adam_square_decay) * gradient_[j] * gradient_[j];
+            parameters[j] -= first_moment_[j] * mean_correction * learning_rate / (std::sqrt(second_moment_[j] * square_correction) + epsilon);
+        }
+        break;
+    }
+    }
+}
+
+double network_trainer::gradient_norm() const {
+    double sum = 0;
+    for (size_t j = 0; j < gradient_.size(); ++j) {
+        sum += gradient_[j] * gradient_[j];
+    }
+    return std::sqrt(sum);
+}
+
+double network_trainer::evaluate() {
+    const size_t num_inputs = network_.num_inputs();
+    const size_t num_outputs = network_.num_outputs();
+    const int threads = int(evaluate_workspaces_.size());
+    const long chunks = long((num_samples_ + evaluate_chunk - 1) / evaluate_chunk);
+    double error = 0;
+
+    #pragma omp parallel for num_threads(threads) reduction(+:error) if(threads > 1)
+    for (long chunk = 0; chunk < chunks; ++chunk) {
+        const size_t begin = size_t(chunk) * evaluate_chunk;
+        const size_t count = std::min(evaluate_chunk, num_samples_ - begin);
+        const double* targets = &targets_[begin * num_outputs];
+        if (fixed_) {
+            error += fixed_->error(network_.parameters().data(), &inputs_[begin * num_inputs], targets, count);
+            continue;
+        }
+        const double* outputs = network_.forward(evaluate_workspaces_[size_t(omp_get_thread_num())], &inputs_[begin * num_inputs], count);
+        for (size_t i = 0; i < count * num_outputs; ++i) {
+            const double d = outputs[i] - targets[i];
+            error += d * d;
+        }
+    }
+
+    return error / num_samples_;
+}
+
+double network_trainer::step(const double learning_rate) {
+    const double e = compute_gradient();
+    update(learning_rate, e);
+    return e;
+}
+
+optimizer_state network_trainer::state() const {
+    optimizer_state result;
+    result.optimizer = optimizer_;
+    result.first_moment = first_moment_;
+    result.second_moment = second_moment_;
+    result.updates = updates_;
+    return result;
+}
+
+bool network_trainer::restore(const optimizer_state& state) {
+    if (state.optimizer != optimizer_ || state.first_moment.size() != first_moment_.size() || state.second_moment.size() != second_moment_.size()) {
+        return false;
+    }
+    first_moment_ = state.first_moment;
+    second_moment_ = state.second_moment;
+    updates_ = state.updates;
+    return true;
+}
+
+convergence_monitor::convergence_monitor(const size_t plateau_iterations, const double plateau_tolerance, const double min_gradient_norm, const double smoothing) : plateau_iterations_(plateau_iterations), plateau_tolerance_(plateau_tolerance), min_gradient_norm_(min_gradient_norm), smoothing_(std::min(std::max(smoothing, 1e-6), 1.0)), steps_(0), since_best_(0), error_(0), gradient_norm_(0), best_(0) {
+}
+
+convergence_monitor::reason convergence_monitor::update(const double error, const double gradient_norm) {
+    if (steps_ == 0) {
+        error_ = error;
+        gradient_norm_ = gradient_norm;
+    } else {
+        error_ += (error - error_) * smoothing_;
+        gradient_norm_ += (gradient_norm - gradient_norm_) * smoothing_;
+    }
+    steps_++;
+
+    /* The averages need about 1 / smoothing steps to forget their start */
+    if (double(steps_) * smoothing_ < 1) {
+        best_ = error_;
+        return running;
+    }
+
+    if (error_ < best_ * (1 - plateau_tolerance_)) {
+        best_ = error_;
+        since_best_ = 0;
+    } else {
+        since_best_++;
+    }
+
+    if (plateau_iterations_ != 0 && since_best_ >= plateau_iterations_) {
+        return plateau;
+    }
+    if (min_gradient_norm_ > 0 && gradient_norm_ < min_gradient_norm_) {
+        return small_gradient;
+    }
+    return running;
+}
@@ -0,0 +1,148 @@
+#ifndef __TRAINER_H__
+#define __TRAINER_H__
+
+#include "network.h"
+#include "fixednetwork.h"
+#include <vector>
+#include <cstddef>
+
+/* How network_trainer::update() turns a gradient into a parameter step.
+ *
+ * sgd scales the gradient by the batch error and the learning rate.
+ * momentum accumulates a velocity (decay 0.9). rmsprop divides by a running
+ * root mean square of the gradient (decay 0.9). adam combines both with the
+ * usual bias correction (0.9, 0.999). */
+enum class optimizer_type {
+    sgd,
+    momentum,
+    rmsprop,
+    adam
+};
+
+/* The per-parameter state of an optimizer, as carried from one training
+ * run to the next. */
+struct optimizer_state {
+    optimizer_state() : optimizer(optimizer_type::sgd), updates(0) {
+    }
+
+    optimizer_type optimizer;
+    std::vector<double> first_moment;
+    std::vector<double> second_moment;
+    size_t updates;
+};
+
+/* Gradient descent on a dense_network over a fixed set of samples.
+ *
+ * Each step takes the next batch_size samples in order (wrapping around),
+ * or every sample when batch_size is 0, and computes the mean gradient of
+ * the squared error. Large batches are split across threads, each with its
+ * own workspace and gradient buffer, and the buffers are summed in
+ * parallel. A batch of one sample reproduces plain per-sample SGD.
+ * Networks with a precompiled fixed_network topology use it in place of
+ * the generic forward and backward passes.
+ *
+ * The adaptive optimizers keep one or two values of state per parameter,
+ * which persist from one update() to the next. */
+class network_trainer {
+public:
+    network_trainer(dense_network& network, const std::vector<double>& inputs, const std::vector<double>& targets, const size_t batch_size, const optimizer_type optimizer = optimizer_type::sgd);
+
+    size_t batch_size() const {
+        return batch_size_;
+    }
+
+    size_t num_samples() const {
+        return num_samples_;
+    }
+
+    /* Gradient from the last step, averaged over its batch */
+    const std::vector<double>& gradient() const {
+        return gradient_;
+    }
+
+    /* Euclidean norm of gradient() */
+    double gradient_norm() const;
+
+    /* Computes the gradient for the next batch and returns the mean error
+     * of the batch. The parameters are not changed. */
+    double compute_gradient();
+
+    /* Moves the parameters against the last gradient. Only sgd scales the
+     * step by the error the gradient was computed at. */
+    void update(const double learning_rate, const double error);
+
+    /* Mean error over every sample at the current parameters, without
+     * computing a gradient. */
+    double evaluate();
+
+    /* compute_gradient() followed by update(). Returns the error. */
+    double step(const double learning_rate);
+
+    /* The optimizer state built up by update() so far */
+    optimizer_state state() const;
+
+    /* Continues from a state returned by state(). Returns false, leaving
+     * the optimizer fresh, if it was saved from a different optimizer or
+     * network size. */
+    bool restore(const optimizer_state& state);
+
+private:
+    double accumulate(dense_workspace& workspace, const double* inputs, const double* targets, const size_t count, double* gradient) const;
+
+    dense_network& network_;
+    std::vector<double> inputs_;
+    std::vector<double> targets_;
+    size_t num_samples_;
+    size_t batch_size_;
+    size_t next_;
+    const fixed_network_kernel* fixed_;
+    std::vector<double> batch_inputs_;
+    std::vector<double> batch_targets_;
+    std::vector<dense_workspace> workspaces_;
+    std::vector<std::vector<double>> gradients_;
+    std::vector<double> gradient_;
+    std::vector<dense_workspace> evaluate_workspaces_;
+    optimizer_type optimizer_;
+    std::vector<double> first_moment_; /* velocity, or Adam's mean */
+    std::vector<double> second_moment_; /* running mean of squared gradients */
+    size_t updates_;
+};
+
+/* Watches the training error and gradient for signs that further steps
+ * are not worth taking.
+ *
+ * Both are smoothed with an exponential moving average, since a single
+ * batch is noisy. Training has plateaued once the smoothed error has gone
+ * plateau_iterations steps without falling by a relative plateau_tolerance
+ * from its best; it has converged once the smoothed gradient norm drops
+ * below min_gradient_norm. Either test is disabled by a zero threshold. */
+class convergence_monitor {
+public:
+    enum reason {
+        running,
+        plateau,
+        small_gradient
+    };
+
+    convergence_monitor(const size_t plateau_iterations, const double plateau_tolerance, const double min_gradient_norm, const double smoothing);
+
+    /* Records one step and returns running until a stopping test passes */
+    reason update(const double error, const double gradient_norm);
+
+    double smoothed_error() const {
+        return error_;
+    }
+
+private:
+    size_t plateau_iterations_;
+    double plateau_tolerance_;
+    double min_gradient_norm_;
+    double smoothing_;
+    size_t steps_;
+    size_t since_best_;
+    double error_;
+    double gradient_norm_;
+    double best_;
+};
+
+#endif /* __TRAINER_H__ */